@@ -0,0 +1,61 @@
+#ifndef BENCHMARKPRESETS_H
+#define BENCHMARKPRESETS_H
+
+#include "../CudaSynth/kernel.h"
+#include "../CudaSynth/defines.h"
+
+// Parameter states shared by the benchmarks.
+// Each preset starts from the ParameterStates defaults and switches on one or more of the costlier features.
+namespace BenchmarkPresets {
+
+	enum Feature {
+		DelayEchoes = 1 << 0,
+		FilterPieces = 1 << 1,
+		LfoDepth = 1 << 2,
+		AllFeatures = DelayEchoes | FilterPieces | LfoDepth,
+	};
+
+	// echoes spaced 250ms apart, each one 15% quieter than the last
+	inline void enableDelayEchoes(ParameterStates *p) {
+		p->delayEnvelope.getSpaceBetweenEchoes()->getAdsr()->setSustain(0.25f);
+		p->delayEnvelope.getAmplitudeLostPerEcho()->getAdsr()->setSustain(0.15f);
+	}
+
+	// use every available filter breakpoint
+	inline void enableFilterPieces(ParameterStates *p) {
+		PiecewiseFunction *shape = p->filterEnvelope.getShape();
+		float step = NYQUIST_RATE_RAD / PIECEWISE_MAX_PIECES;
+		for (int i = 1; shape->numPoints() < PIECEWISE_MAX_PIECES; ++i) {
+			shape->insertPoint(i*step, (i % 2) ? 0.5f : 1.f);
+		}
+	}
+
+	// modulate volume, pan and detune with audible LFOs
+	inline void enableLfoDepth(ParameterStates *p) {
+		ADSRLFOEnvelope *envs[] = { &p->volumeEnvelope, &p->stereoPanEnvelope, p->detuneEnvelope.getAdsrLfo() };
+		for (int i = 0; i < 3; ++i) {
+			envs[i]->getLfo()->getFreqAdsr()->setSustain(30.f);
+			envs[i]->getLfo()->getDepthAdsr()->setSustain(0.3f);
+		}
+	}
+
+	inline void applyFeatures(ParameterStates *p, int features) {
+		if (features & DelayEchoes) {
+			enableDelayEchoes(p);
+		}
+		if (features & FilterPieces) {
+			enableFilterPieces(p);
+		}
+		if (features & LfoDepth) {
+			enableLfoDepth(p);
+		}
+	}
+
+	// human-readable name for a feature combination, e.g. "delay+lfo"
+	inline const char* nameOf(int features) {
+		static const char* names[] = { "default", "delay", "filter", "delay+filter", "lfo", "delay+lfo", "filter+lfo", "all" };
+		return names[features & AllFeatures];
+	}
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*
+==============================================================================
+
+ComponentBenchmarkMain.cpp
+Runs each kernel building block in isolation (see ComponentBenchmarks.cu)
+against the default parameters and a few heavier presets,
+and reports the cost of a single operation of each.
+
+Usage: ComponentBenchmark [output.json]
+
+==============================================================================
+*/
+
+#include "AppConfig.h"
+#include "modules/juce_core/juce_core.h"
+
+#include <stdio.h>
+
+#include "ComponentBenchmarks.h"
+#include "BenchmarkPresets.h"
+
+using namespace juce;
+
+#define BLOCKS_PER_RUN 2048
+// each benchmark is repeated and the fastest run is kept, to filter out scheduling noise
+#define RUNS_PER_BENCHMARK 5
+
+static const int presets[] = {
+	0,
+	BenchmarkPresets::DelayEchoes,
+	BenchmarkPresets::FilterPieces,
+	BenchmarkPresets::LfoDepth,
+	BenchmarkPresets::AllFeatures,
+};
+
+int main(int argc, char **argv) {
+	File outFile = File::getCurrentWorkingDirectory().getChildFile(argc > 1 ? String::fromUTF8(argv[1]) : String("component_benchmark.json"));
+
+	DynamicObject *root = new DynamicObject();
+	var rootVar(root);
+	root->setProperty("numPartials", DEFAULT_NUM_PARTIALS);
+	root->setProperty("blockSize", BUFFER_BLOCK_SIZE);
+	var results;
+
+	printf("%-26s %-13s %12s %8s\n", "component", "preset", "ns/op", "op");
+	for (int b = 0; b < numComponentBenchmarks; ++b) {
+		const ComponentBenchmark &bench = componentBenchmarks[b];
+		for (int p = 0; p < numElementsInArray(presets); ++p) {
+			ParameterStates params;
+			BenchmarkPresets::applyFeatures(&params, presets[p]);
+
+			double bestSec = 0;
+			double numOps = 0;
+			float checksum = 0;
+			for (int run = 0; run < RUNS_PER_BENCHMARK; ++run) {
+				int64 start = Time::getHighResolutionTicks();
+				numOps = bench.run(&params, BLOCKS_PER_RUN, &checksum);
+				double sec = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+				if (run == 0 || sec < bestSec) {
+					bestSec = sec;
+				}
+			}
+			double nsPerOp = bestSec * 1e9 / numOps;
+			printf("%-26s %-13s %12.3f %8s\n", bench.name, BenchmarkPresets::nameOf(presets[p]), nsPerOp, bench.unit);
+
+			DynamicObject *o = new DynamicObject();
+			o->setProperty("component", bench.name);
+			o->setProperty("preset", BenchmarkPresets::nameOf(presets[p]));
+			o->setProperty("unit", bench.unit);
+			o->setProperty("nsPerOp", nsPerOp);
+			o->setProperty("checksum", checksum);
+			results.append(var(o));
+		}
+	}
+	root->setProperty("results", results);
+
+	if (!outFile.replaceWithText(JSON::toString(rootVar))) {
+		fprintf(stderr, "Could not write %s\n", outFile.getFullPathName().toRawUTF8());
+		return 1;
+	}
+	printf("Wrote %s\n", outFile.getFullPathName().toRawUTF8());
+	return 0;
+}
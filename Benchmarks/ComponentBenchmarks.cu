@@ -0,0 +1,193 @@
+// White-box microbenchmarks: pull in the whole kernel so that its internal classes are visible.
+// (This project must therefore NOT also compile kernel.cu on its own.)
+#include "../CudaSynth/kernel.cu"
+
+#include "ComponentBenchmarks.h"
+
+// the partial used whenever a component needs a partial index: the highest one,
+//   so any scaling by partial index is at its strongest.
+#define BENCH_PARTIAL_IDX (DEFAULT_NUM_PARTIALS - 1)
+#define BENCH_PARTIAL_POS ((float)BENCH_PARTIAL_IDX / DEFAULT_NUM_PARTIALS)
+#define BENCH_FUNDAMENTAL_FREQ (220.f*TWICE_PIf)
+
+static double benchSinusoidalValueAtIdx(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	Sinusoidal sinusoid;
+	float freq = (BENCH_PARTIAL_IDX + 1)*BENCH_FUNDAMENTAL_FREQ;
+	float sum = 0.f;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		// phase carries over between blocks, exactly as it does over the course of a note.
+		sinusoid.newFrequencyAndDepth(freq, freq, 1.f, 1.f);
+		for (unsigned idx = 0; idx < BUFFER_BLOCK_SIZE; ++idx) {
+			sum += sinusoid.valueAtIdx(idx);
+		}
+	}
+	*checksum = sum;
+	return (double)numBlocks*BUFFER_BLOCK_SIZE;
+}
+
+static double benchADSRStateAtBlockStart(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	ADSRState state;
+	// compiled once per edit, like the kernel does (see CompiledParameters)
+	CompiledADSR adsr;
+	adsr.compile(params->volumeEnvelope.getAdsr(), BENCH_PARTIAL_POS);
+	float sum = 0.f;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		// release halfway through, so both the held and the released paths are covered
+		state.atBlockStart(&adsr, b >= numBlocks / 2);
+		sum += state.valueAtIdx(0);
+	}
+	*checksum = sum;
+	return numBlocks;
+}
+
+static double benchADSRStateValueAtIdx(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	ADSRState state;
+	CompiledADSR adsr;
+	adsr.compile(params->volumeEnvelope.getAdsr(), BENCH_PARTIAL_POS);
+	float sum = 0.f;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		state.atBlockStart(&adsr, b >= numBlocks / 2);
+		for (unsigned idx = 0; idx < BUFFER_BLOCK_SIZE; ++idx) {
+			sum += state.valueAtIdx(idx);
+		}
+	}
+	*checksum = sum;
+	return (double)numBlocks*BUFFER_BLOCK_SIZE;
+}
+
+static double benchLFOStateAtBlockStart(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	LFOState state;
+	CompiledLFO lfo;
+	lfo.compile(params->volumeEnvelope.getLfo(), BENCH_PARTIAL_POS);
+	float sum = 0.f;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		state.atBlockStart(&lfo, b >= numBlocks / 2);
+		sum += state.valueAtIdx(0);
+	}
+	*checksum = sum;
+	return numBlocks;
+}
+
+static double benchLFOStateValueAtIdx(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	LFOState state;
+	CompiledLFO lfo;
+	lfo.compile(params->volumeEnvelope.getLfo(), BENCH_PARTIAL_POS);
+	float sum = 0.f;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		state.atBlockStart(&lfo, b >= numBlocks / 2);
+		for (unsigned idx = 0; idx < BUFFER_BLOCK_SIZE; ++idx) {
+			sum += state.valueAtIdx(idx);
+		}
+	}
+	*checksum = sum;
+	return (double)numBlocks*BUFFER_BLOCK_SIZE;
+}
+
+static double benchFilterStateValueAtIdx(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	FilterState state;
+	FilterEnvelope *env = &params->filterEnvelope;
+	CompiledFilterEnvelope compiled;
+	compiled.compile(env);
+	float freq = (BENCH_PARTIAL_IDX + 1)*BENCH_FUNDAMENTAL_FREQ;
+	float sum = 0.f;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		state.atBlockStart(env, &compiled, freq, freq, b >= numBlocks / 2, NULL);
+		for (unsigned idx = 0; idx < BUFFER_BLOCK_SIZE; ++idx) {
+			sum += state.valueAtIdx(idx);
+		}
+	}
+	*checksum = sum;
+	return (double)numBlocks*BUFFER_BLOCK_SIZE;
+}
+
+static double benchRandomNumberGenGetFor(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	static RandomNumberGen rng;
+	float seed = params->detuneEnvelope.getRandSeed();
+	float sum = 0.f;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		// one call per partial, as done by CompiledParameters::compile on every edit
+		for (unsigned p = 0; p < DEFAULT_NUM_PARTIALS; ++p) {
+			sum += rng.getFor(seed, p);
+		}
+		seed = fmodf(seed + 0.001f, 1.f);
+	}
+	*checksum = sum;
+	return (double)numBlocks*DEFAULT_NUM_PARTIALS;
+}
+
+static double benchAntiAliasedVolumeForFreq(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	// sweep through the full range of partial frequencies, including those above nyquist.
+	float step = ANTI_ALIAS_FALLOFF_END / BUFFER_BLOCK_SIZE;
+	float sum = 0.f;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		float offset = (b % 8) * step * 0.125f;
+		for (unsigned idx = 0; idx < BUFFER_BLOCK_SIZE; ++idx) {
+			sum += antiAliasedVolumeForFreq(offset + 1.1f * idx * step);
+		}
+	}
+	*checksum = sum;
+	return (double)numBlocks*BUFFER_BLOCK_SIZE;
+}
+
+static SynthVoiceState* newBenchVoiceState() {
+	SynthVoiceState *voiceState = new SynthVoiceState();
+	// the longest buffer a voice can have, so that echoes scatter as widely as they can
+	voiceState->bufferLen = CIRCULAR_BUFFER_LEN;
+	voiceState->sampleBuffer = new float[CIRCULAR_BUFFER_LEN*NUM_CH]();
+	return voiceState;
+}
+
+static SynthVoiceState* benchVoiceState() {
+	static SynthVoiceState *voiceState = newBenchVoiceState();
+	return voiceState;
+}
+
+static double benchReduceOutputs(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	SynthVoiceState *voiceState = benchVoiceState();
+	unsigned baseIdx = 0;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		// same access order as evaluateSynthVoiceBlockOnCpu: partial by partial, sample by sample.
+		for (unsigned p = 0; p < DEFAULT_NUM_PARTIALS; ++p) {
+			for (unsigned idx = 0; idx < BUFFER_BLOCK_SIZE; ++idx) {
+				reduceOutputs(voiceState, p, DEFAULT_NUM_PARTIALS, baseIdx + idx, 0.001f, -0.001f);
+			}
+		}
+		baseIdx += BUFFER_BLOCK_SIZE;
+	}
+	*checksum = voiceState->sampleBuffer[voiceState->bufferIdxOf(baseIdx - 1)];
+	return (double)numBlocks*DEFAULT_NUM_PARTIALS*BUFFER_BLOCK_SIZE;
+}
+
+static double benchReduceDelayOutputs(ParameterStates *params, unsigned numBlocks, float *checksum) {
+	SynthVoiceState *voiceState = benchVoiceState();
+	unsigned delayPerEchoInSamples = params->delayEnvelope.getSpaceBetweenEchoes()->getAdsr()->getSustain()*SAMPLE_RATE;
+	unsigned baseIdx = 0;
+	for (unsigned b = 0; b < numBlocks; ++b) {
+		// same scatter pattern as computePartialOutput
+		for (unsigned p = 0; p < DEFAULT_NUM_PARTIALS; ++p) {
+			for (unsigned idx = 0; idx < BUFFER_BLOCK_SIZE; ++idx) {
+				for (unsigned echoVoiceIdx = 1; echoVoiceIdx <= MAX_DELAY_ECHOES; ++echoVoiceIdx) {
+					unsigned absDelayIdx = baseIdx + idx + echoVoiceIdx + echoVoiceIdx*delayPerEchoInSamples;
+					reduceDelayOutputs(voiceState, p, absDelayIdx, 0.001f, -0.001f);
+				}
+			}
+		}
+		baseIdx += BUFFER_BLOCK_SIZE;
+	}
+	*checksum = voiceState->sampleBuffer[voiceState->bufferIdxOf(baseIdx + delayPerEchoInSamples)];
+	return (double)numBlocks*DEFAULT_NUM_PARTIALS*BUFFER_BLOCK_SIZE*MAX_DELAY_ECHOES;
+}
+
+const ComponentBenchmark componentBenchmarks[] = {
+	{ "Sinusoidal::valueAtIdx", "sample", &benchSinusoidalValueAtIdx },
+	{ "ADSRState::atBlockStart", "block", &benchADSRStateAtBlockStart },
+	{ "ADSRState::valueAtIdx", "sample", &benchADSRStateValueAtIdx },
+	{ "LFOState::atBlockStart", "block", &benchLFOStateAtBlockStart },
+	{ "LFOState::valueAtIdx", "sample", &benchLFOStateValueAtIdx },
+	{ "FilterState::valueAtIdx", "sample", &benchFilterStateValueAtIdx },
+	{ "RandomNumberGen::getFor", "call", &benchRandomNumberGenGetFor },
+	{ "antiAliasedVolumeForFreq", "call", &benchAntiAliasedVolumeForFreq },
+	{ "reduceOutputs", "call", &benchReduceOutputs },
+	{ "reduceDelayOutputs", "call", &benchReduceDelayOutputs },
+};
+const int numComponentBenchmarks = sizeof(componentBenchmarks) / sizeof(componentBenchmarks[0]);
@@ -0,0 +1,22 @@
+#ifndef COMPONENTBENCHMARKS_H
+#define COMPONENTBENCHMARKS_H
+
+#include "../CudaSynth/kernel.h"
+
+// Microbenchmarks for the individual building blocks of computePartialOutput.
+// The building blocks are private to kernel.cu, so ComponentBenchmarks.cu includes kernel.cu directly
+//   and exposes them to ComponentBenchmarkMain.cpp through this table.
+struct ComponentBenchmark {
+	const char *name;
+	// what a single operation is, e.g. "sample" or "block"
+	const char *unit;
+	// run the component over numBlocks blocks worth of work, configured from params.
+	// Returns the number of operations performed.
+	// *checksum receives a value derived from every output, so that the work cannot be optimized away.
+	double (*run)(ParameterStates *params, unsigned numBlocks, float *checksum);
+};
+
+extern const ComponentBenchmark componentBenchmarks[];
+extern const int numComponentBenchmarks;
+
+#endif
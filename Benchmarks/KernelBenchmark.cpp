@@ -0,0 +1,442 @@
+/*
+==============================================================================
+
+KernelBenchmark.cpp
+End-to-end throughput benchmark for the CPU synthesis kernel.
+
+Sweeps the voice count (powers of 2 up to maxVoices) and feature toggles (delay echoes, filter pieces, LFO depth)
+and times kernel::evaluateSynthVoiceBlockOnCpu for every block.
+The partial count is a runtime setting (numPartials); BUFFER_BLOCK_SIZE is a compile-time constant, so sweep it by
+rebuilding with different values (see README.md). Each result records the values it was run with.
+
+Usage: KernelBenchmark [output.json] [maxVoices] [numPartials]
+       KernelBenchmark --check
+
+With --check, it instead renders a few notes and checks that the kernel's shortcuts hold up (see runChecks),
+exiting with 1 if any of them fails.
+
+==============================================================================
+*/
+
+#include "AppConfig.h"
+#include "modules/juce_core/juce_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "../CudaSynth/kernel.h"
+#include "../CudaSynth/defines.h"
+#include "../CudaSynth/SimdKernel.h"
+#include "BenchmarkPresets.h"
+
+using namespace juce;
+
+// blocks rendered (and discarded) before timing starts, so the envelopes reach their sustain phase
+#define WARMUP_BLOCKS 64
+#define TIMED_BLOCKS 512
+
+struct BenchmarkResult {
+	int numVoices;
+	int features;
+	double nsPerSample;
+	double samplesPerSecPerCore;
+	double p50BlockSec, p99BlockSec, maxBlockSec;
+};
+
+static double percentile(const std::vector<double> &sorted, double p) {
+	size_t idx = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[idx];
+}
+
+// 1, 2, 4, ..., always finishing on maxVoices itself
+static int nextVoiceCount(int numVoices, int maxVoices) {
+	return (numVoices < maxVoices && numVoices * 2 > maxVoices) ? maxVoices : numVoices * 2;
+}
+
+static BenchmarkResult runOne(int numVoices, int numPartials, int features) {
+	ParameterStates params;
+	params.setNumPartials(numPartials);
+	BenchmarkPresets::applyFeatures(&params, features);
+	kernel::parameterStatesChanged(&params);
+	float block[BUFFER_BLOCK_SIZE*NUM_CH];
+	for (int v = 0; v < numVoices; ++v) {
+		kernel::onNoteStart(v);
+	}
+	// spread the voices over a few octaves so they don't all alias identically
+	std::vector<float> freqs(numVoices);
+	for (int v = 0; v < numVoices; ++v) {
+		freqs[v] = 220.f * TWICE_PIf * (1.f + 0.5f*v);
+	}
+
+	unsigned baseIdx = 0;
+	for (int b = 0; b < WARMUP_BLOCKS; ++b) {
+		for (int v = 0; v < numVoices; ++v) {
+			kernel::evaluateSynthVoiceBlockOnCpu(block, v, baseIdx, freqs[v], false);
+		}
+		baseIdx += BUFFER_BLOCK_SIZE;
+	}
+
+	// time each block (all voices rendered back-to-back on this core)
+	std::vector<double> blockSec;
+	blockSec.reserve(TIMED_BLOCKS);
+	for (int b = 0; b < TIMED_BLOCKS; ++b) {
+		int64 start = Time::getHighResolutionTicks();
+		for (int v = 0; v < numVoices; ++v) {
+			kernel::evaluateSynthVoiceBlockOnCpu(block, v, baseIdx, freqs[v], false);
+		}
+		blockSec.push_back(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start));
+		baseIdx += BUFFER_BLOCK_SIZE;
+	}
+
+	double totalSec = 0;
+	for (size_t i = 0; i < blockSec.size(); ++i) {
+		totalSec += blockSec[i];
+	}
+	std::sort(blockSec.begin(), blockSec.end());
+	double numSamples = (double)TIMED_BLOCKS * BUFFER_BLOCK_SIZE * numVoices;
+
+	BenchmarkResult r;
+	r.numVoices = numVoices;
+	r.features = features;
+	r.nsPerSample = totalSec * 1e9 / numSamples;
+	r.samplesPerSecPerCore = numSamples / totalSec;
+	r.p50BlockSec = percentile(blockSec, 0.50);
+	r.p99BlockSec = percentile(blockSec, 0.99);
+	r.maxBlockSec = blockSec.back();
+	return r;
+}
+
+static var toJson(const BenchmarkResult &r, double deadlineSec) {
+	DynamicObject *o = new DynamicObject();
+	o->setProperty("voices", r.numVoices);
+	o->setProperty("features", BenchmarkPresets::nameOf(r.features));
+	o->setProperty("nsPerSample", r.nsPerSample);
+	o->setProperty("samplesPerSecPerCore", r.samplesPerSecPerCore);
+	o->setProperty("p50BlockMs", r.p50BlockSec * 1e3);
+	o->setProperty("p99BlockMs", r.p99BlockSec * 1e3);
+	o->setProperty("maxBlockMs", r.maxBlockSec * 1e3);
+	// fraction of the realtime budget used by the worst-case block; > 1 means an underrun
+	o->setProperty("maxDeadlineFraction", r.maxBlockSec / deadlineSec);
+	return var(o);
+}
+
+// renders up to numBlocks blocks of a note at fundamentalFreq (rad/s) on voice 0, released from block releaseBlock on,
+//   returning the frames (interleaved by channel) up to the end of the note and the time the kernel spent on them
+static std::vector<float> renderNote(const ParameterStates *params, float fundamentalFreq, int numBlocks, int releaseBlock, double *seconds) {
+	kernel::parameterStatesChanged(params);
+	float block[BUFFER_BLOCK_SIZE*NUM_CH];
+	// a block's envelopes run from the parameters of the block before it, so render one to leave the earlier ones behind
+	kernel::onNoteStart(0);
+	kernel::evaluateSynthVoiceBlockOnCpu(block, 0, 0, fundamentalFreq, true);
+	kernel::onNoteStart(0);
+	std::vector<float> frames;
+	*seconds = 0;
+	for (int b = 0; b < numBlocks; ++b) {
+		int64 start = Time::getHighResolutionTicks();
+		kernel::VoiceBlockStatus status = kernel::evaluateSynthVoiceBlockOnCpu(block, 0, b*BUFFER_BLOCK_SIZE, fundamentalFreq, b >= releaseBlock);
+		*seconds += Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start);
+		frames.insert(frames.end(), block, block + BUFFER_BLOCK_SIZE*NUM_CH);
+		if (status.isNoteFinished()) {
+			break;
+		}
+	}
+	return frames;
+}
+
+// the largest difference between two renders over the frames they share, or infinity if either is not finite there
+static float maxDifference(const std::vector<float> &a, const std::vector<float> &b) {
+	float maxDiff = 0.f;
+	for (size_t i = 0; i < std::min(a.size(), b.size()); ++i) {
+		float diff = fabsf(a[i] - b[i]);
+		if (!(diff <= maxDiff)) {
+			maxDiff = (diff == diff) ? diff : INFINITY;
+		}
+	}
+	return maxDiff;
+}
+
+// Partials at or above Nyquist must be skipped, not merely rendered at zero volume:
+//   a high note sounds exactly as if it had only its partials below Nyquist, and costs about as much.
+// The default filter also mutes everything past Nyquist, so the check opens it up to leave the anti-aliasing alone.
+static bool checkHighNoteCulling() {
+	const int numBlocks = 256;
+	const int numPartials = 120;
+	// partials 1 to 11 of 2 kHz are below Nyquist; the other 109 are above it (and there are too few for IfftSynth to take over)
+	const float highFreq = 2000.f * TWICE_PIf;
+	const int numAudible = 11;
+	const float lowFreq = 220.f * TWICE_PIf;
+	bool passed = true;
+	for (int simd = 0; simd < 2; ++simd) {
+		kernel::setSimdEnabled(simd != 0);
+		ParameterStates params, audibleOnly;
+		params.filterEnvelope.getShape()->movePoint(3, NYQUIST_RATE_RAD, 1);
+		audibleOnly.filterEnvelope.getShape()->movePoint(3, NYQUIST_RATE_RAD, 1);
+		params.setNumPartials(numPartials);
+		audibleOnly.setNumPartials(numAudible);
+		for (int p = 0; p < numAudible; ++p) {
+			audibleOnly.partialLevels[p] = params.partialLevels[p];
+		}
+		double highSec, audibleSec, lowSec;
+		std::vector<float> high = renderNote(&params, highFreq, numBlocks, numBlocks, &highSec);
+		std::vector<float> expected = renderNote(&audibleOnly, highFreq, numBlocks, numBlocks, &audibleSec);
+		renderNote(&params, lowFreq, numBlocks, numBlocks, &lowSec);
+		bool isExact = high == expected;
+		// skipping the inaudible partials makes highSec about as long as audibleSec, rendering them all about as long as lowSec.
+		// Splitting the difference leaves plenty of slack for timing noise, and for the cost of a block that isn't in its partials.
+		bool isFast = highSec < 0.5*(audibleSec + lowSec);
+		printf("high note culling (%s): %i of %i partials audible, output %s, %.1f ms vs %.1f ms with only those and %.1f ms for a low note: %s\n",
+			simd ? kernel::getBackendName() : "scalar", numAudible, numPartials, isExact ? "identical" : "DIFFERS",
+			highSec * 1e3, audibleSec * 1e3, lowSec * 1e3, (isExact && isFast) ? "ok" : "FAILED");
+		passed = passed && isExact && isFast;
+	}
+	kernel::setSimdEnabled(true);
+	return passed;
+}
+
+// echoes spaced 50 ms apart, each one 30% quieter than the last
+static void setEchoes(ParameterStates *params, bool dependsOnPartialIdx) {
+	ADSR *space = params->delayEnvelope.getSpaceBetweenEchoes()->getAdsr();
+	space->setSustain(0.05f);
+	params->delayEnvelope.getAmplitudeLostPerEcho()->getAdsr()->setSustain(0.3f);
+	// too small to change any segment's length (1 + 1e-9*partialPos rounds to 1), but enough to scatter the echoes
+	space->setScaleByPartialIdx(dependsOnPartialIdx ? 1e-9f : 0.f);
+}
+
+// Echoes that don't depend on the partial are mixed into the voice's summed output after the partials render (see mixEchoesOfSample),
+//   rather than scattered by every partial. Both must give the same note, tail included, and nothing else in the buffer
+//   (such as an end-of-note marker) may be echoed along with it.
+static bool checkMixedEchoes() {
+	const int numBlocks = 400;
+	const int releaseBlock = 100;
+	const float freq = 440.f * TWICE_PIf;
+	bool passed = true;
+	for (int simd = 0; simd < 2; ++simd) {
+		kernel::setSimdEnabled(simd != 0);
+		ParameterStates mixed, scattered;
+		setEchoes(&mixed, false);
+		setEchoes(&scattered, true);
+		double seconds;
+		std::vector<float> mixedFrames = renderNote(&mixed, freq, numBlocks, releaseBlock, &seconds);
+		std::vector<float> scatteredFrames = renderNote(&scattered, freq, numBlocks, releaseBlock, &seconds);
+		float maxDiff = std::max(maxDifference(mixedFrames, mixedFrames), maxDifference(mixedFrames, scatteredFrames));
+		// the partials are summed before their echoes are, rather than after
+		bool isClose = maxDiff <= 1e-5f;
+		// both end once the last echo has died away, which is well past the release
+		int mixedBlocks = (int)mixedFrames.size() / (BUFFER_BLOCK_SIZE*NUM_CH);
+		int scatteredBlocks = (int)scatteredFrames.size() / (BUFFER_BLOCK_SIZE*NUM_CH);
+		bool hasTail = mixedBlocks > releaseBlock + 1 && mixedBlocks < numBlocks && std::abs(mixedBlocks - scatteredBlocks) <= 1;
+		printf("mixed echoes (%s): differ from scattered ones by %g, note ends after %i blocks (scattered: %i): %s\n",
+			simd ? kernel::getBackendName() : "scalar", maxDiff, mixedBlocks, scatteredBlocks, (isClose && hasTail) ? "ok" : "FAILED");
+		passed = passed && isClose && hasTail;
+	}
+	kernel::setSimdEnabled(true);
+	return passed;
+}
+
+// Every SIMD backend stays within the tolerances of SimdKernel.h of the scalar path on every preset, from the note's start
+//   to the end of its tail: SIMD_KERNEL_TOLERANCE at full audio rate, and SIMD_ROTATOR_TOLERANCE with the rotator as well.
+static bool checkSimdTolerances() {
+	const char *backendNames[] = { "sse", "avx2", "avx512" };
+	const int numBlocks = 200;
+	const int releaseBlock = 150;
+	const float freq = 440.f * TWICE_PIf;
+	String bestBackend = kernel::getBackendName();
+	// the tolerances hold at full audio rate
+	kernel::setControlInterval(1);
+	bool passed = true;
+	for (int features = 0; features <= BenchmarkPresets::AllFeatures; ++features) {
+		ParameterStates params;
+		BenchmarkPresets::applyFeatures(&params, features);
+		double seconds;
+		kernel::setSimdEnabled(false);
+		std::vector<float> scalar = renderNote(&params, freq, numBlocks, releaseBlock, &seconds);
+		kernel::setSimdEnabled(true);
+		for (int b = 0; b < 3; ++b) {
+			if (!kernel::setBackend(backendNames[b])) {
+				continue;
+			}
+			float maxDiffs[2];
+			for (int useRotator = 0; useRotator < 2; ++useRotator) {
+				kernel::setRotatorEnabled(useRotator != 0);
+				maxDiffs[useRotator] = maxDifference(scalar, renderNote(&params, freq, numBlocks, releaseBlock, &seconds));
+			}
+			bool isWithin = maxDiffs[0] <= SIMD_KERNEL_TOLERANCE && maxDiffs[1] <= SIMD_ROTATOR_TOLERANCE;
+			printf("simd tolerances (%s, %s): differs from scalar by %g (within %g), with the rotator by %g (within %g): %s\n",
+				BenchmarkPresets::nameOf(features), backendNames[b], maxDiffs[0], SIMD_KERNEL_TOLERANCE,
+				maxDiffs[1], SIMD_ROTATOR_TOLERANCE, isWithin ? "ok" : "FAILED");
+			passed = passed && isWithin;
+		}
+	}
+	kernel::setBackend(bestBackend.toRawUTF8());
+	kernel::setRotatorEnabled(true);
+	kernel::setControlInterval(DEFAULT_CONTROL_INTERVAL);
+	return passed;
+}
+
+// At control rate (see kernel::setControlInterval), each partial's gains follow straight lines between the control points.
+// On every preset, from the note's start to the end of its tail, that strays from the audio-rate output of the same backend
+//   by no more than the given bound: at DEFAULT_CONTROL_INTERVAL, which is what plays, and at MAX_CONTROL_INTERVAL.
+static bool checkControlRate() {
+	const int numBlocks = 200;
+	const int releaseBlock = 150;
+	const float freq = 440.f * TWICE_PIf;
+	const unsigned intervals[2] = { DEFAULT_CONTROL_INTERVAL, MAX_CONTROL_INTERVAL };
+	// the presets with a detune LFO sweep their partials across the filter's breakpoints, which a straight line follows least well
+	const float maxDiffBounds[2] = { 2e-3f, 1e-2f };
+	bool passed = true;
+	for (int features = 0; features <= BenchmarkPresets::AllFeatures; ++features) {
+		ParameterStates params;
+		BenchmarkPresets::applyFeatures(&params, features);
+		double seconds;
+		kernel::setControlInterval(1);
+		std::vector<float> audioRate = renderNote(&params, freq, numBlocks, releaseBlock, &seconds);
+		float maxDiffs[2];
+		bool isWithin = true;
+		for (int i = 0; i < 2; ++i) {
+			kernel::setControlInterval(intervals[i]);
+			std::vector<float> controlRate = renderNote(&params, freq, numBlocks, releaseBlock, &seconds);
+			maxDiffs[i] = controlRate.size() == audioRate.size() ? maxDifference(audioRate, controlRate) : INFINITY;
+			isWithin = isWithin && maxDiffs[i] <= maxDiffBounds[i];
+		}
+		printf("control rate (%s, %s): differs from audio rate by %g at interval %u (within %g) and by %g at %u (within %g): %s\n",
+			BenchmarkPresets::nameOf(features), kernel::getBackendName(), maxDiffs[0], intervals[0], maxDiffBounds[0],
+			maxDiffs[1], intervals[1], maxDiffBounds[1], isWithin ? "ok" : "FAILED");
+		passed = passed && isWithin;
+	}
+	kernel::setControlInterval(DEFAULT_CONTROL_INTERVAL);
+	return passed;
+}
+
+// With kernel::setIfftEnabled, a voice of IFFT_MIN_PARTIALS partials synthesized by inverse FFT stays within 1e-3
+//   of the same voice rendered sample by sample, from the note's start to the end of its tail, on every preset without LFOs.
+// Frames can't follow a partial that an LFO moves within a hop, so the presets with LFOs are left out.
+static bool checkIfft() {
+	const int numBlocks = 200;
+	const int releaseBlock = 150;
+	// low enough for every partial to be audible
+	const float freq = 55.f * TWICE_PIf;
+	const float maxDiffBound = 1e-3f;
+	bool passed = true;
+	for (int features = 0; features <= BenchmarkPresets::AllFeatures; ++features) {
+		if (features & BenchmarkPresets::LfoDepth) {
+			continue;
+		}
+		ParameterStates params;
+		BenchmarkPresets::applyFeatures(&params, features);
+		params.setNumPartials(IFFT_MIN_PARTIALS);
+		double sampledSec, ifftSec;
+		std::vector<float> sampled = renderNote(&params, freq, numBlocks, releaseBlock, &sampledSec);
+		kernel::setIfftEnabled(true);
+		std::vector<float> ifft = renderNote(&params, freq, numBlocks, releaseBlock, &ifftSec);
+		kernel::setIfftEnabled(false);
+		float maxDiff = ifft.size() == sampled.size() ? maxDifference(sampled, ifft) : INFINITY;
+		bool isWithin = maxDiff <= maxDiffBound;
+		printf("ifft (%s, %s, %i partials): differs from the sample-by-sample render by %g (within %g), %.1f ms vs %.1f ms: %s\n",
+			BenchmarkPresets::nameOf(features), kernel::getBackendName(), IFFT_MIN_PARTIALS, maxDiff, maxDiffBound,
+			ifftSec * 1e3, sampledSec * 1e3, isWithin ? "ok" : "FAILED");
+		passed = passed && isWithin;
+	}
+	return passed;
+}
+
+// the largest magnitude of the frames from first up to (not including) last
+static float peakOf(const std::vector<float> &frames, size_t first, size_t last) {
+	float peak = 0.f;
+	for (size_t i = first; i < std::min(last, frames.size()); ++i) {
+		peak = std::max(peak, fabsf(frames[i]));
+	}
+	return peak;
+}
+
+// Releasing a note must not make it louder, at any control interval.
+// The default release only lasts a few samples, and the default delay envelope releases into echoes one sample apart:
+//   a release stretched over a whole control interval used to come back as a burst louder than the note.
+static bool checkReleaseTransients() {
+	const unsigned intervals[3] = { 1, DEFAULT_CONTROL_INTERVAL, MAX_CONTROL_INTERVAL };
+	const float freqs[2] = { 880.f * TWICE_PIf, 220.f * TWICE_PIf };
+	const int releaseBlocks[2] = { 50, 200 };
+	bool passed = true;
+	for (int i = 0; i < 3; ++i) {
+		kernel::setControlInterval(intervals[i]);
+		for (int n = 0; n < 2; ++n) {
+			ParameterStates params;
+			double seconds;
+			std::vector<float> frames = renderNote(&params, freqs[n], releaseBlocks[n] + 20, releaseBlocks[n], &seconds);
+			size_t releaseFrame = (size_t)releaseBlocks[n] * BUFFER_BLOCK_SIZE*NUM_CH;
+			float heldPeak = peakOf(frames, 0, releaseFrame);
+			float releasedPeak = peakOf(frames, releaseFrame, frames.size());
+			bool isQuieter = releasedPeak <= heldPeak;
+			printf("release transients (%s, interval %u): %.0f Hz peaks at %g once released (held: %g): %s\n",
+				kernel::getBackendName(), intervals[i], freqs[n] / TWICE_PIf, releasedPeak, heldPeak, isQuieter ? "ok" : "FAILED");
+			passed = passed && isQuieter;
+		}
+	}
+	kernel::setControlInterval(DEFAULT_CONTROL_INTERVAL);
+	return passed;
+}
+
+static bool runChecks() {
+	kernel::setPolyphony(1);
+	// steady voices would otherwise be played from a wavetable, which hides what the partial loop costs
+	kernel::setWavetableCacheEnabled(false);
+	bool passed = checkHighNoteCulling();
+	passed = checkMixedEchoes() && passed;
+	passed = checkSimdTolerances() && passed;
+	passed = checkControlRate() && passed;
+	passed = checkReleaseTransients() && passed;
+	passed = checkIfft() && passed;
+	kernel::setWavetableCacheEnabled(true);
+	printf(passed ? "All checks passed\n" : "Some checks FAILED\n");
+	return passed;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && String::fromUTF8(argv[1]) == "--check") {
+		return runChecks() ? 0 : 1;
+	}
+	File outFile = File::getCurrentWorkingDirectory().getChildFile(argc > 1 ? String::fromUTF8(argv[1]) : String("kernel_benchmark.json"));
+	int maxVoices = argc > 2 ? atoi(argv[2]) : DEFAULT_SIMULTANEOUS_SYNTH_NOTES;
+	if (maxVoices < 1 || maxVoices > MAX_SIMULTANEOUS_SYNTH_NOTES) {
+		fprintf(stderr, "maxVoices must be between 1 and %i\n", MAX_SIMULTANEOUS_SYNTH_NOTES);
+		return 1;
+	}
+	int numPartials = argc > 3 ? atoi(argv[3]) : DEFAULT_NUM_PARTIALS;
+	if (numPartials < 1 || numPartials > MAX_PARTIALS) {
+		fprintf(stderr, "numPartials must be between 1 and %i\n", MAX_PARTIALS);
+		return 1;
+	}
+	kernel::setPolyphony(maxVoices);
+	const double deadlineSec = (double)BUFFER_BLOCK_SIZE / SAMPLE_RATE;
+
+	DynamicObject *root = new DynamicObject();
+	var rootVar(root);
+	root->setProperty("backend", String(kernel::getBackendName()));
+	root->setProperty("numPartials", numPartials);
+	root->setProperty("blockSize", BUFFER_BLOCK_SIZE);
+	root->setProperty("sampleRate", SAMPLE_RATE);
+	root->setProperty("deadlineMs", deadlineSec * 1e3);
+	root->setProperty("cpu", SystemStats::getCpuVendor() + " @ " + String(SystemStats::getCpuSpeedInMegaherz()) + " MHz");
+	var results;
+
+	printf("backend=%s partials=%i blockSize=%i deadline=%.3fms\n", kernel::getBackendName(), numPartials, BUFFER_BLOCK_SIZE, deadlineSec * 1e3);
+	printf("%-7s %-13s %10s %14s %9s %9s %9s\n", "voices", "features", "ns/sample", "samples/s/core", "p50 ms", "p99 ms", "max ms");
+	for (int numVoices = 1; numVoices <= maxVoices; numVoices = nextVoiceCount(numVoices, maxVoices)) {
+		for (int features = 0; features <= BenchmarkPresets::AllFeatures; ++features) {
+			BenchmarkResult r = runOne(numVoices, numPartials, features);
+			printf("%-7i %-13s %10.2f %14.0f %9.3f %9.3f %9.3f\n", r.numVoices, BenchmarkPresets::nameOf(r.features),
+				r.nsPerSample, r.samplesPerSecPerCore, r.p50BlockSec * 1e3, r.p99BlockSec * 1e3, r.maxBlockSec * 1e3);
+			results.append(toJson(r, deadlineSec));
+		}
+	}
+	root->setProperty("results", results);
+
+	if (!outFile.replaceWithText(JSON::toString(rootVar))) {
+		fprintf(stderr, "Could not write %s\n", outFile.getFullPathName().toRawUTF8());
+		return 1;
+	}
+	printf("Wrote %s\n", outFile.getFullPathName().toRawUTF8());
+	return 0;
+}
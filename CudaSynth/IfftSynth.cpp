@@ -0,0 +1,149 @@
+#include "IfftSynth.h"
+
+#include <math.h>
+#include <string.h> // for memset
+
+namespace kernel {
+namespace ifft {
+
+	// samples of the window's spectrum per bin, and the half-width (in bins) of the part of it that partials add
+	static const int KERNEL_OVERSAMPLING = 256;
+	static const int KERNEL_HALF_WIDTH = IFFT_KERNEL_BINS / 2;
+	// spectrum of the window at offsets -KERNEL_HALF_WIDTH to +KERNEL_HALF_WIDTH bins from a partial's frequency,
+	//   plus one entry so the last offset can still be interpolated.
+	static float kernelTable[IFFT_KERNEL_BINS*KERNEL_OVERSAMPLING + 2];
+	// triangle / (window * IFFT_SIZE) for offsets -IFFT_HOP_SIZE to IFFT_HOP_SIZE-1 from the frame center:
+	//   undoes the window (and the scaling of the unnormalized inverse transform), then crossfades with the neighbouring frames.
+	static float overlapGain[2 * IFFT_HOP_SIZE];
+
+	// 4-term Blackman-Harris window (92 dB sidelobes), centered on offset 0
+	static const double WINDOW_COEFFS[4] = { 0.35875, 0.48829, 0.14128, 0.01168 };
+
+	static double windowAt(int m) {
+		double theta = 2 * PI * m / IFFT_SIZE;
+		return WINDOW_COEFFS[0] + WINDOW_COEFFS[1] * cos(theta) + WINDOW_COEFFS[2] * cos(2 * theta) + WINDOW_COEFFS[3] * cos(3 * theta);
+	}
+
+	// sum of cos(2*pi*bin*m/IFFT_SIZE) over the frame (m = -IFFT_SIZE/2 to IFFT_SIZE/2-1): the spectrum of a rectangular frame
+	static double rectangleSpectrumAt(double bin) {
+		double theta = 2 * PI * bin / IFFT_SIZE;
+		if (fabs(sin(0.5*theta)) < 1e-12) {
+			return IFFT_SIZE * cos(0.5 * IFFT_SIZE * theta);
+		}
+		return sin(0.5 * (IFFT_SIZE - 1) * theta) / sin(0.5*theta) + cos(0.5 * IFFT_SIZE * theta);
+	}
+
+	// each cosine term of the window shifts the rectangle's spectrum by its number of cycles, half up and half down
+	static double windowSpectrumAt(double bin) {
+		double sum = WINDOW_COEFFS[0] * rectangleSpectrumAt(bin);
+		for (int term = 1; term < 4; ++term) {
+			sum += 0.5 * WINDOW_COEFFS[term] * (rectangleSpectrumAt(bin - term) + rectangleSpectrumAt(bin + term));
+		}
+		return sum;
+	}
+
+	static float kernelAt(double offset) {
+		double position = (offset + KERNEL_HALF_WIDTH) * KERNEL_OVERSAMPLING;
+		int idx = (int)position;
+		float frac = (float)(position - idx);
+		return kernelTable[idx] + frac*(kernelTable[idx + 1] - kernelTable[idx]);
+	}
+
+	void init() {
+		for (int i = 0; i < IFFT_KERNEL_BINS*KERNEL_OVERSAMPLING + 2; ++i) {
+			kernelTable[i] = (float)windowSpectrumAt((double)i / KERNEL_OVERSAMPLING - KERNEL_HALF_WIDTH);
+		}
+		for (int m = -IFFT_HOP_SIZE; m < IFFT_HOP_SIZE; ++m) {
+			double triangle = 1.0 - fabs((double)m) / IFFT_HOP_SIZE;
+			overlapGain[m + IFFT_HOP_SIZE] = (float)(triangle / (windowAt(m) * IFFT_SIZE));
+		}
+	}
+
+	void inverseTransform(float *re, float *im, unsigned size) {
+		// radix-2 decimation in time. First put the inputs in bit-reversed order.
+		for (unsigned i = 0, j = 0; i < size; ++i) {
+			if (i < j) {
+				float tmpRe = re[i], tmpIm = im[i];
+				re[i] = re[j];
+				im[i] = im[j];
+				re[j] = tmpRe;
+				im[j] = tmpIm;
+			}
+			// increment j as a bit-reversed counter
+			unsigned bit = size >> 1;
+			while (j & bit) {
+				j ^= bit;
+				bit >>= 1;
+			}
+			j |= bit;
+		}
+		for (unsigned span = 2; span <= size; span *= 2) {
+			unsigned half = span / 2;
+			// the twiddle factor e^(2*pi*i*k/span) is advanced by rotation, in double precision so it doesn't drift
+			double stepRe = cos(2 * PI / span), stepIm = sin(2 * PI / span);
+			double twiddleRe = 1, twiddleIm = 0;
+			for (unsigned k = 0; k < half; ++k) {
+				float wRe = (float)twiddleRe;
+				float wIm = (float)twiddleIm;
+				for (unsigned a = k; a < size; a += span) {
+					unsigned b = a + half;
+					float tRe = re[b] * wRe - im[b] * wIm;
+					float tIm = re[b] * wIm + im[b] * wRe;
+					re[b] = re[a] - tRe;
+					im[b] = im[a] - tIm;
+					re[a] += tRe;
+					im[a] += tIm;
+				}
+				double nextRe = twiddleRe*stepRe - twiddleIm*stepIm;
+				twiddleIm = twiddleRe*stepIm + twiddleIm*stepRe;
+				twiddleRe = nextRe;
+			}
+		}
+	}
+
+	void Frame::clear() {
+		memset(re, 0, sizeof(re));
+		memset(im, 0, sizeof(im));
+	}
+
+	void Frame::addPartial(float freq, double phase, float ampL, float ampR) {
+		// the frame holds left + i*right. A sinusoid a*sin(phase + freq*m) is a*e^(i*phase)/(2i) at +freq and its conjugate at -freq,
+		//   so with A = ampL + i*ampR, the partial puts A*u at +freq and A*conj(u) at -freq, where u = e^(i*phase)/(2i).
+		float uRe = 0.5f*(float)sin(phase);
+		float uIm = -0.5f*(float)cos(phase);
+		float posRe = ampL*uRe - ampR*uIm;
+		float posIm = ampL*uIm + ampR*uRe;
+		float negRe = ampL*uRe + ampR*uIm;
+		float negIm = ampR*uRe - ampL*uIm;
+		// each is spread over the bins nearest its frequency, weighted by the window's spectrum.
+		// Bins wrap around, so frequencies past Nyquist alias just as they do when rendered sample by sample.
+		double centerBin = freq * (IFFT_SIZE / (2 * PI));
+		int firstPos = (int)floor(centerBin) - (KERNEL_HALF_WIDTH - 1);
+		int firstNeg = (int)floor(-centerBin) - (KERNEL_HALF_WIDTH - 1);
+		for (int i = 0; i < IFFT_KERNEL_BINS; ++i) {
+			int bin = (firstPos + i) & (IFFT_SIZE - 1);
+			float weight = kernelAt(firstPos + i - centerBin);
+			re[bin] += weight*posRe;
+			im[bin] += weight*posIm;
+		}
+		for (int i = 0; i < IFFT_KERNEL_BINS; ++i) {
+			int bin = (firstNeg + i) & (IFFT_SIZE - 1);
+			float weight = kernelAt(firstNeg + i + centerBin);
+			re[bin] += weight*negRe;
+			im[bin] += weight*negIm;
+		}
+	}
+
+	void Frame::transform() {
+		inverseTransform(re, im, IFFT_SIZE);
+	}
+
+	void Frame::outputAt(int m, float *outL, float *outR) const {
+		unsigned idx = (unsigned)m & (IFFT_SIZE - 1);
+		float gain = overlapGain[m + IFFT_HOP_SIZE];
+		*outL = re[idx] * gain;
+		*outR = im[idx] * gain;
+	}
+
+}
+}
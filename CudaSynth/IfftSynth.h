@@ -0,0 +1,46 @@
+#ifndef IFFTSYNTH_H
+#define IFFTSYNTH_H
+
+#include "defines.h"
+
+// Additive synthesis by inverse FFT and overlap-add (the FFT^-1 method of Rodet & Depalle).
+// Instead of summing every partial sample by sample, each partial adds a few bins (the main lobe of the window's spectrum)
+//   to a spectral frame, and one inverse FFT then yields all of the partials at once.
+// Frames are IFFT_SIZE samples long and IFFT_HOP_SIZE apart. Each one is divided by the window it was synthesized with
+//   and crossfaded into its neighbours with a triangle, so a partial is treated as a stationary sinusoid
+//   (constant amplitude, frequency and pan) around each frame center.
+// Both channels share one complex transform: the left channel is its real part, the right channel its imaginary part.
+
+// distance between frame centers. Each block is covered by three frames, centered on its start, its middle and its end,
+//   so that it doesn't depend on the frames of its neighbours.
+#define IFFT_HOP_SIZE (BUFFER_BLOCK_SIZE / 2)
+#define IFFT_FRAMES_PER_BLOCK 3
+// transform length (BUFFER_BLOCK_SIZE must be a power of two). Four hops keep the triangle within the bulk of the
+//   window, where dividing by it doesn't amplify the error from truncating its spectrum.
+#define IFFT_SIZE (4 * IFFT_HOP_SIZE)
+// number of bins each partial adds to a frame: the main lobe of the 4-term Blackman-Harris window
+#define IFFT_KERNEL_BINS 8
+
+namespace kernel {
+namespace ifft {
+	// precompute the window and kernel tables. Must be called once before any Frame is used.
+	void init();
+	// inverse DFT of size complex values (size must be a power of two), in place and without the 1/size scaling
+	void inverseTransform(float *re, float *im, unsigned size);
+
+	class Frame {
+		float re[IFFT_SIZE], im[IFFT_SIZE];
+	public:
+		void clear();
+		// add a partial: ampL*sin(phase + freq*m) to the left channel and ampR*sin(phase + freq*m) to the right,
+		//   where m is the offset in samples from the frame center and freq is in rad/sample (0 to pi).
+		void addPartial(float freq, double phase, float ampL, float ampR);
+		// turn the spectrum into samples (in place)
+		void transform();
+		// the samples at offset m from the frame center (-IFFT_HOP_SIZE < m < IFFT_HOP_SIZE), already weighted for overlap-add.
+		void outputAt(int m, float *outL, float *outR) const;
+	};
+}
+}
+
+#endif
@@ -0,0 +1,39 @@
+#include "PartialCountEditor.h"
+
+static const char* labelNames[] = { "count" };
+static const char* tooltips[] = { "Number of partials (harmonics) in the sound" };
+static const float partialCountParameterBounds[][2] = { { 1, MAX_PARTIALS } };
+static const int partialCountUsableIndices[] = { 0, -1 };
+
+
+PartialCountEditor::PartialCountEditor(PluginEditor *editor, ParameterStates *parameterStates, const char* editorLabel)
+	: ParameterEditor(editor, editorLabel, labelNames, tooltips, partialCountParameterBounds, partialCountUsableIndices),
+	parameterStates(parameterStates)
+{
+	// sync GUI with parameter values
+	refreshSliderValues();
+}
+
+
+PartialCountEditor::~PartialCountEditor()
+{
+}
+
+float PartialCountEditor::getParameterValue(int parameterNum) const {
+	switch (parameterNum) {
+	case 0:
+		return parameterStates->numPartials;
+	default:
+		return 0.f;
+	}
+}
+
+void PartialCountEditor::onParameterChanged(int parameterNum, float value) {
+	switch (parameterNum) {
+	case 0: // Count
+		parameterStates->setNumPartials((unsigned)(value + 0.5f));
+		break;
+	default:
+		break;
+	}
+}
\ No newline at end of file
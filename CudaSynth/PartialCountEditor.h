@@ -0,0 +1,19 @@
+#ifndef PARTIALCOUNTEDITOR_H
+#define PARTIALCOUNTEDITOR_H
+
+#include "ParameterEditor.h"
+#include "kernel.h"
+
+class PartialCountEditor :
+	public ParameterEditor
+{
+	ParameterStates *parameterStates;
+public:
+	PartialCountEditor(PluginEditor *editor, ParameterStates *parameterStates, const char* editorLabel);
+	~PartialCountEditor();
+	void onParameterChanged(int parameterNum, float value) override;
+	float getParameterValue(int parameterNum) const override;
+};
+
+
+#endif
\ No newline at end of file
@@ -8,9 +8,9 @@
 #define PARTIAL_EDITOR_HEIGHT 100
 
 
-PartialLevelsComponent::PartialLevelsComponent(PluginEditor *editor, float *partialLevels)
+PartialLevelsComponent::PartialLevelsComponent(PluginEditor *editor, ParameterStates *parameterStates)
 	: editor(editor),
-	  partialLevels(partialLevels)
+	  parameterStates(parameterStates)
 {
 	setSize(PARTIAL_EDITOR_WIDTH, PARTIAL_EDITOR_HEIGHT);
 }
@@ -24,25 +24,28 @@ void PartialLevelsComponent::paint(Graphics &g)
 {
 	//g.fillAll(Colours::black);
 	g.setColour(Colour(0xBD, 0x00, 0x00));
-	for (int p = 0; p < NUM_PARTIALS; ++p) {
-		int pxPerPartial = getWidth() / NUM_PARTIALS;
-		int x = pxPerPartial * p;
-		int w = std::min(3, pxPerPartial - 1);
-		int top = getHeight() * (1.0 - partialLevels[p]*NUM_PARTIALS);
+	unsigned numPartials = parameterStates->numPartials;
+	// with many partials, each one gets less than a pixel
+	float pxPerPartial = getWidth() / (float)numPartials;
+	float w = std::max(1.f, std::min(3.f, pxPerPartial - 1));
+	for (unsigned p = 0; p < numPartials; ++p) {
+		float x = pxPerPartial * p;
+		float top = getHeight() * (1.0f - parameterStates->partialLevels[p]*numPartials);
 		//g.drawVerticalLine(x, top, getHeight());
-		g.fillRect(x, top, w, getHeight());
+		g.fillRect(x, top, w, (float)getHeight());
 	}
 }
 
 void PartialLevelsComponent::updateFromMouseEvent(const MouseEvent &event) {
 	int x = event.getPosition().getX();
-	int pxPerPartial = getWidth() / NUM_PARTIALS;
-	int partialIdx = (x+0.5*pxPerPartial) / pxPerPartial;
-	if (0 <= partialIdx && partialIdx < NUM_PARTIALS) {
+	unsigned numPartials = parameterStates->numPartials;
+	float pxPerPartial = getWidth() / (float)numPartials;
+	int partialIdx = (int)(x / pxPerPartial + 0.5f);
+	if (0 <= partialIdx && partialIdx < (int)numPartials) {
 		float level = 1.0f - event.getPosition().getY() / (float)getHeight();
 		// clamp the level to between 0 and 1.
 		level = std::max(0.0f, std::min(1.0f, level));
-		partialLevels[partialIdx] = level / NUM_PARTIALS;
+		parameterStates->partialLevels[partialIdx] = level / numPartials;
 		editor->parametersChanged();
 		repaint();
 	}
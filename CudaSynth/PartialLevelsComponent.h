@@ -2,15 +2,16 @@
 #define PARTIALLEVELSCOMPONENT_H
 
 #include "JuceLibraryCode/JuceHeader.h"
+#include "kernel.h"
 
 class PluginEditor;
 
 class PartialLevelsComponent : public Component {
 	PluginEditor *editor;
-	float *partialLevels;
+	ParameterStates *parameterStates;
 	void updateFromMouseEvent(const MouseEvent &event);
 public:
-	PartialLevelsComponent(PluginEditor *editor, float *partialLevels);
+	PartialLevelsComponent(PluginEditor *editor, ParameterStates *parameterStates);
 	~PartialLevelsComponent();
 	void paint(Graphics& g) override;
 	void mouseDown(const MouseEvent &event) override;
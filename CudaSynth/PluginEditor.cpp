@@ -6,7 +6,8 @@ PluginEditor::PluginEditor(PluginProcessor& owner)
 	: AudioProcessorEditor(owner),
 	  tooltipWindow(this, 1500),
       midiKeyboard (owner.keyboardState, MidiKeyboardComponent::horizontalKeyboard),
-	  partialLevelsComponent(this, parameterStates.partialLevels),
+	  partialLevelsComponent(this, &parameterStates),
+	  partialCountEditor(this, &parameterStates, "Partials"),
 	  volumeADSR(this, parameterStates.volumeEnvelope.getAdsr(), "Volume", ADSREditor::ClassicKnobs, ADSREditor::NormalizedDepthLimits),
 	  volumeLFOFreq(this, parameterStates.volumeEnvelope.getLfo()->getFreqAdsr(), "LFO Freq", ADSREditor::AsrWithPeaksKnobs, ADSREditor::LFOFrequencyLimits),
 	  volumeLFODepth(this, parameterStates.volumeEnvelope.getLfo()->getDepthAdsr(), "LFO Depth", ADSREditor::AsrWithPeaksKnobs, ADSREditor::NormalizedDepthLimitsPlusOrMinus),
@@ -24,6 +25,7 @@ PluginEditor::PluginEditor(PluginProcessor& owner)
 {
 	// add the parameter editors
 	addAndMakeVisible(partialLevelsComponent);
+	addAndMakeVisible(partialCountEditor);
 	addAndMakeVisible(volumeADSR);
 	addAndMakeVisible(volumeLFOFreq);
 	addAndMakeVisible(volumeLFODepth);
@@ -78,7 +80,7 @@ void PluginEditor::resized()
 
 	// position the ADSR editors
 	int padding = 6;
-	Component* volumeEditors[] = { &volumeADSR, &volumeLFOFreq, &volumeLFODepth, NULL };
+	Component* volumeEditors[] = { &partialCountEditor, &volumeADSR, &volumeLFOFreq, &volumeLFODepth, NULL };
 	Component* stereoEditors[] = { &stereoADSR, &stereoLFOFreq, &stereoLFODepth, NULL };
 	Component* detuneEditors[] = { &detuneRandEditor, &detuneADSR, &detuneLFOFreq, &detuneLFODepth, NULL };
 	Component* delayEditors[] = { &delaySpaceADSR, &delayAmpLossADSR, NULL };
@@ -108,4 +110,6 @@ void PluginEditor::resized()
 
 void PluginEditor::parametersChanged() {
 	kernel::parameterStatesChanged(&parameterStates);
+	// the partial count may have changed, which rescales every level
+	partialLevelsComponent.repaint();
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "JuceLibraryCode/JuceHeader.h"
 #include "PluginProcessor.h"
 #include "PartialLevelsComponent.h"
+#include "PartialCountEditor.h"
 #include "ADSREditor.h"
 #include "DetuneRandEditor.h"
 #include "PiecewiseEditor.h"
@@ -27,6 +28,7 @@ private:
 	ParameterStates parameterStates;
     MidiKeyboardComponent midiKeyboard;
 	PartialLevelsComponent partialLevelsComponent;
+	PartialCountEditor partialCountEditor;
 	ADSREditor volumeADSR, volumeLFOFreq, volumeLFODepth;
 	ADSREditor stereoADSR, stereoLFOFreq, stereoLFODepth;
 	DetuneRandEditor detuneRandEditor;
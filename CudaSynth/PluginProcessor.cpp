@@ -8,15 +8,14 @@
   ==============================================================================
 */
 
-#include <thread>
-#include <mutex>
 #include <atomic>
-#include <condition_variable>
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 #include "kernel.h"
 #include "defines.h"
+#include "RenderedBlockFifo.h"
+#include "RenderThreadPool.h"
 
 #ifndef PI
 	#define PI 3.14159265358979323846
@@ -36,38 +35,76 @@ public:
 
 //==============================================================================
 /** A simple demo synth voice that just plays a sine wave.. */
-class AdditiveSynthVoice  : public SynthesiserVoice
+class AdditiveSynthVoice  : public SynthesiserVoice, private RenderThreadPool::Job
 {
+	// shared by all voices of all plugin instances; declared first so that it outlives our queued jobs.
+	SharedResourcePointer<RenderThreadPool> renderPool;
 	// this acts as an ID to associate this voice with the resources on the GPU side.
 	unsigned myVoiceNumber;
-	//we use a double-buffering strategy to allow bufferDrain to be drained into the audio output
-	//  while bufferFill is being filled in in a different thread.
-	//Once bufferDrain is fully drained, it waits for bufferFill to be filled and then swaps the pointers:
-	//  bufferDrain* with bufferFill*, which point to either one of the underlying bufferA, bufferB buffers.
-	float bufferA[BUFFER_BLOCK_SIZE*NUM_CH], bufferB[BUFFER_BLOCK_SIZE*NUM_CH];
-	// flag to kill the worker thread (done upon destruction of the Voice @ program shutdown)
+	//A fill job on renderPool renders up to RENDER_AHEAD_BLOCKS blocks ahead into renderedBlocks,
+	//  while the audio callback drains the oldest one directly out of the fifo (no copies, no locks).
+	//If the audio callback finds the fifo empty, it outputs a block of silence and counts an underrun
+	//  rather than waiting for the fill job.
+	RenderedBlockFifo renderedBlocks;
+	// the block currently being drained (owned by renderedBlocks), or nullptr if we have none.
+	const float *drainBlock;
+	// whether drainBlock is the last block of the note, after which the voice is freed.
+	bool isDrainingLastBlock;
+	unsigned int sampleIdx;
+	// incremented on every startNote. The fill job restarts the voice on the kernel side when it sees a new value,
+	//   and tags every block with the generation it was rendered for,
+	//   so that blocks rendered ahead for a previous note can be dropped by the audio callback.
+	std::atomic<unsigned> noteGeneration;
+	// whether the fill job has anything to render
+	std::atomic<bool> isNotePlaying;
+	// until the first block of a note arrives, an empty fifo is just note-on latency, not an underrun.
+	bool hasNoteOutputStarted;
+	std::atomic<unsigned> numUnderruns;
+	// cleared upon destruction of the Voice, so that a fill job that is still queued does nothing
 	std::atomic<bool> isAlive;
 	// pass on to the synth kernel that the note is in release mode (ADSR)
 	std::atomic<bool> wasNoteReleased;
 	std::atomic<float> fundamentalFreq;
-	unsigned int sampleIdx;
-	std::mutex bufferBMutex;
-	bool needFillBuffer;
-	std::condition_variable needFillBufferCV;
-	std::thread fillThread;
+	// state of our fill job on renderPool. There is at most one in flight at any time.
+	enum FillJobState {
+		FILL_IDLE,
+		// queued or running
+		FILL_QUEUED,
+		// queued or running, and asked for more work since it last started filling
+		FILL_REQUESTED_AGAIN,
+		// voice is being destroyed; no more jobs may be queued
+		FILL_DEAD,
+	};
+	std::atomic<int> fillJobState;
+	// only touched by the fill job:
+	unsigned baseIdx;
+	unsigned renderingGeneration;
+	// set once the kernel reports the note finished; nothing more is rendered for renderingGeneration.
+	bool hasRenderedLastBlock;
 public:
 	AdditiveSynthVoice(unsigned voiceNum) : myVoiceNumber(voiceNum),
-		isAlive(true), wasNoteReleased(false), fundamentalFreq(0), sampleIdx(0),
-		needFillBuffer(false),
-		fillThread([](AdditiveSynthVoice *v) { v->fillLoop(); }, this) {
-		memset(bufferA, 0, BUFFER_BLOCK_SIZE*NUM_CH*sizeof(float));
-		memset(bufferB, 0, BUFFER_BLOCK_SIZE*NUM_CH*sizeof(float));
+		drainBlock(nullptr), isDrainingLastBlock(false), sampleIdx(0), noteGeneration(0), isNotePlaying(false),
+		hasNoteOutputStarted(false), numUnderruns(0),
+		isAlive(true), wasNoteReleased(false), fundamentalFreq(0),
+		fillJobState(FILL_IDLE),
+		baseIdx(0), renderingGeneration(0), hasRenderedLastBlock(false) {
+		// makes room in the pool for our fill job, so that queueing it from the audio thread never allocates
+		renderPool->registerJob();
 	}
 	~AdditiveSynthVoice() {
-		//signal fillThread to exit
+		// a queued fill job still points at us: let it run out before we go away.
 		isAlive.store(false);
-		needFillBufferCV.notify_one();
-		fillThread.join();
+		int state = FILL_IDLE;
+		while (!fillJobState.compare_exchange_weak(state, FILL_DEAD)) {
+			state = FILL_IDLE;
+			Thread::yield();
+		}
+		renderPool->unregisterJob();
+	}
+
+	// number of blocks that the fill job failed to render in time
+	unsigned getNumUnderruns() const {
+		return numUnderruns.load();
 	}
 
     bool canPlaySound (SynthesiserSound* sound) override
@@ -79,17 +116,19 @@ public:
                     SynthesiserSound* /*sound*/,
                     int /*currentPitchWheelPosition*/) override
     {
-		std::unique_lock<std::mutex> lock(bufferBMutex);
-		memset(bufferA, 0, sizeof(bufferB));
-		memset(bufferB, 0, sizeof(bufferB));
-
-		sampleIdx = BUFFER_BLOCK_SIZE; // trigger a re-render of the current block
+		releaseDrainBlock();
+		sampleIdx = BUFFER_BLOCK_SIZE; // trigger a fetch of the next block
+		hasNoteOutputStarted = false;
 		wasNoteReleased = false;
 
 		double cyclesPerSecond = MidiMessage::getMidiNoteInHertz(midiNoteNumber);
 		assert(getSampleRate() == SAMPLE_RATE);
 		fundamentalFreq = cyclesPerSecond * 2*PI;
-		kernel::onNoteStart(myVoiceNumber);
+		// publish the new generation only after the note's parameters are in place;
+		//   the fill job calls kernel::onNoteStart once it picks it up.
+		++noteGeneration;
+		isNotePlaying = true;
+		requestFill();
     }
 
     void stopNote (float /*velocity*/, bool allowTailOff) override
@@ -98,7 +137,7 @@ public:
 		wasNoteReleased = true;
 		if (!allowTailOff) {
 			// if we aren't allowed to do the release phase, end the note immediately.
-			clearCurrentNote();
+			endNote();
 		}
     }
 
@@ -119,48 +158,105 @@ public:
 		}
 		for (int localIdx = startSample; localIdx < startSample + numSamples; ++localIdx) {
 			if (sampleIdx == BUFFER_BLOCK_SIZE) {
+				if (isDrainingLastBlock) {
+					// the partials and their echoes have all died away
+					printf("ending note from within renderNextBlock callback\n");
+					endNote();
+					return;
+				}
 				sampleIdx = 0;
-				waitAndSwapBuffers();
-			} else if (sampleIdx == BUFFER_BLOCK_SIZE - 1 && std::isnan(bufferA[(BUFFER_BLOCK_SIZE - 1) * NUM_CH])) {
-				// NaN at last buffer point signals end of note.
-				printf("ending note from within renderNextBlock callback\n");
-				bufferA[(BUFFER_BLOCK_SIZE - 1) * NUM_CH] = 0;
-				clearCurrentNote();
-				return;
+				fetchNextBlock();
 			}
-			for (int ch = outputBuffer.getNumChannels(); --ch >= 0;) {
-				outputBuffer.addSample(ch, localIdx, bufferA[sampleIdx * NUM_CH + ch]);
+			if (drainBlock != nullptr) {
+				for (int ch = outputBuffer.getNumChannels(); --ch >= 0;) {
+					outputBuffer.addSample(ch, localIdx, drainBlock[sampleIdx * NUM_CH + ch]);
+				}
 			}
 			++sampleIdx;
 		}
     }
-	void waitAndSwapBuffers() {
-		//acquire lock on buffer B:
-		std::unique_lock<std::mutex> lock(bufferBMutex);
-		//copy buffer B into buffer A:
-		memcpy(bufferA, bufferB, BUFFER_BLOCK_SIZE*NUM_CH*sizeof(float));
-
-		//release buffer B lock and notify the filler thread.
-		needFillBuffer = true;
-		needFillBufferCV.notify_one();
+	void fetchNextBlock() {
+		releaseDrainBlock();
+		unsigned generation = noteGeneration.load();
+		unsigned tag;
+		bool isLastOfNote;
+		float *block;
+		// drop any blocks that were rendered ahead for a previous note
+		while ((block = renderedBlocks.getReadSlot(&tag, &isLastOfNote)) != nullptr && tag != generation) {
+			renderedBlocks.release();
+			requestFill();
+		}
+		drainBlock = block;
+		isDrainingLastBlock = block != nullptr && isLastOfNote;
+		if (block != nullptr) {
+			hasNoteOutputStarted = true;
+		} else if (hasNoteOutputStarted) {
+			// the fill job fell behind: this block is output as silence.
+			++numUnderruns;
+		}
+	}
+	void releaseDrainBlock() {
+		isDrainingLastBlock = false;
+		if (drainBlock != nullptr) {
+			drainBlock = nullptr;
+			renderedBlocks.release();
+			requestFill();
+		}
+	}
+	void endNote() {
+		releaseDrainBlock();
+		isNotePlaying = false;
+		clearCurrentNote();
 	}
 
-	void fillLoop() {
-		unsigned baseIdx = 0;
-		while (1) {
-			// get access to buffer B
-			std::unique_lock<std::mutex> lock(bufferBMutex);
-			// wait until we are asked to fill the buffer, and then clear the flag
-			needFillBufferCV.wait(lock, [this]() { return this->needFillBuffer || !this->isAlive; });
-			if (!isAlive) {
+	// make sure a fill job will run after this call. Never blocks, so it's safe on the audio thread.
+	void requestFill() {
+		int state = fillJobState.load();
+		while (true) {
+			if (state == FILL_IDLE) {
+				if (fillJobState.compare_exchange_weak(state, FILL_QUEUED)) {
+					renderPool->submit(this);
+					return;
+				}
+			} else if (state == FILL_QUEUED) {
+				if (fillJobState.compare_exchange_weak(state, FILL_REQUESTED_AGAIN)) {
+					return;
+				}
+			} else {
+				return;
+			}
+		}
+	}
+	// RenderThreadPool::Job
+	void run() override {
+		while (true) {
+			fillJobState = FILL_QUEUED;
+			fillFreeSlots();
+			// if nothing was requested while we were filling, we're done.
+			// This must be the last access to the voice, as it may be destroyed as soon as we're idle.
+			int state = FILL_QUEUED;
+			if (fillJobState.compare_exchange_strong(state, FILL_IDLE)) {
+				return;
+			}
+		}
+	}
+	void fillFreeSlots() {
+		float *block;
+		while (isAlive && isNotePlaying && (block = renderedBlocks.getWriteSlot()) != nullptr) {
+			unsigned generation = noteGeneration.load();
+			if (generation != renderingGeneration) {
+				kernel::onNoteStart(myVoiceNumber);
+				renderingGeneration = generation;
+				hasRenderedLastBlock = false;
+			}
+			if (hasRenderedLastBlock) {
+				// the rest of the note is silence; the audio callback frees the voice after the last block
 				return;
 			}
-			this->needFillBuffer = false;
-
 			// fill the buffer
-			//printf("Was note released?: %i\n", wasNoteReleased.load());
-			evaluateSynthVoiceBlock(bufferB, myVoiceNumber, baseIdx, fundamentalFreq, wasNoteReleased);
-			//printf("last value in buffer: %f\n", bufferB[(BUFFER_BLOCK_SIZE - 1) * NUM_CH]);
+			VoiceBlockStatus status = evaluateSynthVoiceBlock(block, myVoiceNumber, baseIdx, fundamentalFreq, wasNoteReleased);
+			hasRenderedLastBlock = status.isNoteFinished();
+			renderedBlocks.publish(generation, hasRenderedLastBlock);
 			baseIdx += BUFFER_BLOCK_SIZE;
 		}
 	}
@@ -185,13 +281,27 @@ PluginProcessor::PluginProcessor()
 
     lastPosInfo.resetToDefault();
     delayPosition = 0;
+	polyphony = DEFAULT_SIMULTANEOUS_SYNTH_NOTES;
 
     // Initialise the synth...
+	createVoices();
+	synth.addSound(new AdditiveSynthSound());
+}
+
+void PluginProcessor::createVoices()
+{
 	// At runtime, each note gets assigned to a voice,
 	// so we must create N voices to achieve a polyphony of N.
-	for (int i = MAX_SIMULTANEOUS_SYNTH_NOTES; --i >= 0;)
+	// The old voices must be gone before the kernel reallocates their state.
+	synth.clearVoices();
+	kernel::setPolyphony(polyphony);
+	for (int i = polyphony; --i >= 0;)
 		synth.addVoice(new AdditiveSynthVoice(i));
-	synth.addSound(new AdditiveSynthSound());
+}
+
+void PluginProcessor::setPolyphony(int numVoices)
+{
+	polyphony = jlimit(1, MAX_SIMULTANEOUS_SYNTH_NOTES, numVoices);
 }
 
 PluginProcessor::~PluginProcessor()
@@ -203,6 +313,17 @@ PluginProcessor::~PluginProcessor()
 	}
 }
 
+unsigned PluginProcessor::getNumUnderruns()
+{
+	unsigned total = 0;
+	for (int i = 0; i < synth.getNumVoices(); ++i) {
+		if (AdditiveSynthVoice *voice = dynamic_cast<AdditiveSynthVoice*>(synth.getVoice(i))) {
+			total += voice->getNumUnderruns();
+		}
+	}
+	return total;
+}
+
 //==============================================================================
 int PluginProcessor::getNumParameters()
 {
@@ -269,6 +390,8 @@ void PluginProcessor::prepareToPlay(double sampleRate, int /*samplesPerBlock*/)
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
+    if (synth.getNumVoices() != polyphony)
+        createVoices();
     synth.setCurrentPlaybackSampleRate (sampleRate);
     keyboardState.reset();
     delayBuffer.clear();
@@ -340,6 +463,7 @@ void PluginProcessor::getStateInformation(MemoryBlock& destData)
     xml.setAttribute ("uiHeight", lastUIHeight);
     xml.setAttribute ("gain", gain);
     xml.setAttribute ("delay", delay);
+    xml.setAttribute ("polyphony", polyphony);
 
     // then use this helper function to stuff it into the binary blob and return it..
     copyXmlToBinary (xml, destData);
@@ -364,6 +488,7 @@ void PluginProcessor::setStateInformation(const void* data, int sizeInBytes)
 
             gain  = (float) xmlState->getDoubleAttribute ("gain", gain);
             delay = (float) xmlState->getDoubleAttribute ("delay", delay);
+            setPolyphony (xmlState->getIntAttribute ("polyphony", polyphony));
         }
     }
 }
@@ -94,6 +94,15 @@ public:
 
     float gain, delay;
 
+    // total number of blocks (across all voices) that were output as silence
+    // because the render threads could not keep up.
+    unsigned getNumUnderruns();
+
+    // number of voices (notes that can sound at once).
+    // Changes take effect at the next prepareToPlay, since the voices can't be rebuilt while audio is running.
+    int getPolyphony() const                         { return polyphony; }
+    void setPolyphony (int numVoices);
+
 private:
     //==============================================================================
     AudioSampleBuffer delayBuffer;
@@ -101,6 +110,9 @@ private:
 
     // the synth!
     Synthesiser synth;
+    int polyphony;
+
+    void createVoices();
 
 	FileLogger *fileLogger;
 
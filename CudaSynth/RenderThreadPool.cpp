@@ -0,0 +1,165 @@
+#include "RenderThreadPool.h"
+
+#define JOB_DEQUE_INITIAL_CAPACITY 64
+
+RenderThreadPool::JobDeque::JobDeque()
+	: jobs(JOB_DEQUE_INITIAL_CAPACITY),
+	  capacity(JOB_DEQUE_INITIAL_CAPACITY), head(0), numJobs(0)
+{
+}
+
+void RenderThreadPool::JobDeque::reserve(int minCapacity) {
+	// nothing else changes the capacity, so it can be read without the lock
+	if (minCapacity <= capacity) {
+		return;
+	}
+	int newCapacity = capacity;
+	while (newCapacity < minCapacity) {
+		newCapacity *= 2;
+	}
+	// allocate before taking the lock, which the audio thread may be waiting on, and free the old ring after letting go of it
+	HeapBlock<Job*> grown(newCapacity);
+	const SpinLock::ScopedLockType lock(this->lock);
+	for (int i = 0; i < numJobs; ++i) {
+		grown[i] = jobs[(head + i) % capacity];
+	}
+	jobs.swapWith(grown);
+	capacity = newCapacity;
+	head = 0;
+}
+
+void RenderThreadPool::JobDeque::pushBack(Job *job) {
+	const SpinLock::ScopedLockType lock(this->lock);
+	// registerJob made room for every job that can be queued at once
+	jassert(numJobs < capacity);
+	jobs[(head + numJobs) % capacity] = job;
+	++numJobs;
+}
+
+RenderThreadPool::Job* RenderThreadPool::JobDeque::popBack() {
+	const SpinLock::ScopedLockType lock(this->lock);
+	if (numJobs == 0) {
+		return nullptr;
+	}
+	--numJobs;
+	return jobs[(head + numJobs) % capacity];
+}
+
+RenderThreadPool::Job* RenderThreadPool::JobDeque::popFront() {
+	const SpinLock::ScopedLockType lock(this->lock);
+	if (numJobs == 0) {
+		return nullptr;
+	}
+	Job *job = jobs[head];
+	head = (head + 1) % capacity;
+	--numJobs;
+	return job;
+}
+
+
+class RenderThreadPool::Worker : public Thread
+{
+	RenderThreadPool &pool;
+	int idx;
+public:
+	// whether this worker is currently running a job (as opposed to looking for one or sleeping)
+	Atomic<int> isBusy;
+
+	Worker(RenderThreadPool &pool, int idx)
+		: Thread("CudaSynth render " + String(idx)),
+		  pool(pool), idx(idx)
+	{
+	}
+
+	void run() override
+	{
+		while (!threadShouldExit()) {
+			if (Job *job = pool.findJob(idx)) {
+				isBusy = 1;
+				job->run();
+				isBusy = 0;
+			} else {
+				// sleep until submit() hands us something
+				wait(-1);
+			}
+		}
+	}
+};
+
+
+RenderThreadPool::RenderThreadPool()
+	: numRegisteredJobs(0)
+{
+	int numWorkers = jmax(1, SystemStats::getNumCpus());
+	for (int i = 0; i < numWorkers; ++i) {
+		deques.add(new JobDeque());
+	}
+	for (int i = 0; i < numWorkers; ++i) {
+		workers.add(new Worker(*this, i));
+		// the audio callback outputs silence if these fall behind, so run them above normal priority.
+		workers[i]->startThread(8);
+	}
+}
+
+RenderThreadPool::~RenderThreadPool()
+{
+	for (int i = 0; i < workers.size(); ++i) {
+		workers[i]->signalThreadShouldExit();
+		workers[i]->notify();
+	}
+	for (int i = 0; i < workers.size(); ++i) {
+		workers[i]->stopThread(-1);
+	}
+}
+
+void RenderThreadPool::registerJob()
+{
+	const ScopedLock lock(registrationLock);
+	++numRegisteredJobs;
+	for (int i = 0; i < deques.size(); ++i) {
+		deques[i]->reserve(numRegisteredJobs);
+	}
+}
+
+void RenderThreadPool::unregisterJob()
+{
+	// the deques keep their room, in case jobs are registered again
+	const ScopedLock lock(registrationLock);
+	--numRegisteredJobs;
+}
+
+int RenderThreadPool::getNumWorkers() const
+{
+	return workers.size();
+}
+
+void RenderThreadPool::submit(Job *job)
+{
+	int idx = (++nextWorker & 0x7fffffff) % workers.size();
+	deques[idx]->pushBack(job);
+	workers[idx]->notify();
+	if (workers[idx]->isBusy.get()) {
+		// the owner may be stuck rendering for a while: wake an idle worker so it can steal the job instead.
+		for (int i = 1; i < workers.size(); ++i) {
+			Worker *other = workers[(idx + i) % workers.size()];
+			if (!other->isBusy.get()) {
+				other->notify();
+				break;
+			}
+		}
+	}
+}
+
+RenderThreadPool::Job* RenderThreadPool::findJob(int idx)
+{
+	// newest job of our own deque first, then the oldest job of anyone else's.
+	if (Job *job = deques[idx]->popBack()) {
+		return job;
+	}
+	for (int i = 1; i < deques.size(); ++i) {
+		if (Job *job = deques[(idx + i) % deques.size()]->popFront()) {
+			return job;
+		}
+	}
+	return nullptr;
+}
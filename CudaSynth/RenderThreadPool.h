@@ -0,0 +1,62 @@
+#ifndef RENDERTHREADPOOL_H
+#define RENDERTHREADPOOL_H
+
+#include "JuceLibraryCode/JuceHeader.h"
+
+// Fixed-size pool of render threads shared by every voice of every plugin instance in the process
+//   (obtain it through a SharedResourcePointer<RenderThreadPool>).
+// There is one worker per CPU core, each with its own deque of jobs:
+//   a worker runs the newest job of its own deque first, and when that is empty it steals the oldest job of another worker.
+class RenderThreadPool
+{
+public:
+	class Job
+	{
+	public:
+		virtual ~Job() {}
+		// called on one of the pool's threads. Must not be submitted again until it has started running.
+		virtual void run() = 0;
+	};
+
+	RenderThreadPool();
+	~RenderThreadPool();
+	// a job must be registered for as long as it may be submitted, so that every deque has room for all of them
+	//   and submit() never has to allocate. These may allocate, so call them when the job is created and destroyed,
+	//   not from the audio thread.
+	void registerJob();
+	void unregisterJob();
+	// queue a registered job and wake a worker to run it. Safe to call from the audio thread.
+	void submit(Job *job);
+	int getNumWorkers() const;
+private:
+	// a ring of jobs guarded by a spinlock, which is only ever held for a handful of instructions.
+	class JobDeque
+	{
+		SpinLock lock;
+		HeapBlock<Job*> jobs;
+		int capacity, head, numJobs;
+	public:
+		JobDeque();
+		// make room for at least minCapacity jobs. Only called by one thread at a time.
+		void reserve(int minCapacity);
+		void pushBack(Job *job);
+		Job* popBack();
+		Job* popFront();
+	};
+	class Worker;
+
+	OwnedArray<JobDeque> deques;
+	OwnedArray<Worker> workers;
+	// round-robin index of the next worker to submit to
+	Atomic<int> nextWorker;
+	// each registered job is queued at most once at a time, so no deque ever holds more than this many
+	int numRegisteredJobs;
+	CriticalSection registrationLock;
+
+	// the next job for worker idx to run, or nullptr if every deque is empty.
+	Job* findJob(int idx);
+
+	JUCE_DECLARE_NON_COPYABLE(RenderThreadPool)
+};
+
+#endif
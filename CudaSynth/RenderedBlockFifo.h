@@ -0,0 +1,69 @@
+#ifndef RENDEREDBLOCKFIFO_H
+#define RENDEREDBLOCKFIFO_H
+
+#include "JuceLibraryCode/JuceHeader.h"
+#include "defines.h"
+
+// Wait-free single-producer / single-consumer ring of rendered sample blocks.
+// The producer (a voice's fill thread) renders straight into a free slot and then publishes it;
+//   the consumer (the audio callback) reads straight out of the oldest published slot and releases it once drained.
+// No samples are copied, and neither side ever blocks: a full ring yields nullptr to the producer,
+//   an empty ring yields nullptr to the consumer.
+// Each block carries a tag (the note generation it was rendered for), so that the consumer can
+//   discard blocks that were rendered ahead for a note that has since been replaced,
+//   and whether it is the last block of its note (see kernel::VoiceBlockStatus::isNoteFinished).
+class RenderedBlockFifo
+{
+	// one slot is being drained by the consumer, and AbstractFifo always keeps one slot empty.
+	enum { NUM_SLOTS = RENDER_AHEAD_BLOCKS + 2 };
+	AbstractFifo fifo;
+	float blocks[NUM_SLOTS][BUFFER_BLOCK_SIZE*NUM_CH];
+	unsigned tags[NUM_SLOTS];
+	bool endsNote[NUM_SLOTS];
+
+	static int slotOf(int start1, int size1, int start2, int size2) {
+		return size1 > 0 ? start1 : (size2 > 0 ? start2 : -1);
+	}
+public:
+	RenderedBlockFifo() : fifo(NUM_SLOTS) {
+		memset(blocks, 0, sizeof(blocks));
+		memset(tags, 0, sizeof(tags));
+		memset(endsNote, 0, sizeof(endsNote));
+	}
+
+	// producer: the slot to render the next block into, or nullptr if the consumer is RENDER_AHEAD_BLOCKS behind.
+	float* getWriteSlot() {
+		int start1, size1, start2, size2;
+		fifo.prepareToWrite(1, start1, size1, start2, size2);
+		int slot = slotOf(start1, size1, start2, size2);
+		return slot < 0 ? nullptr : blocks[slot];
+	}
+	// producer: make the block obtained from getWriteSlot visible to the consumer.
+	void publish(unsigned tag, bool isLastOfNote) {
+		int start1, size1, start2, size2;
+		fifo.prepareToWrite(1, start1, size1, start2, size2);
+		int slot = slotOf(start1, size1, start2, size2);
+		tags[slot] = tag;
+		endsNote[slot] = isLastOfNote;
+		fifo.finishedWrite(1);
+	}
+
+	// consumer: the oldest published block (left in place until release()), or nullptr if none are ready.
+	float* getReadSlot(unsigned *tag, bool *isLastOfNote) {
+		int start1, size1, start2, size2;
+		fifo.prepareToRead(1, start1, size1, start2, size2);
+		int slot = slotOf(start1, size1, start2, size2);
+		if (slot < 0) {
+			return nullptr;
+		}
+		*tag = tags[slot];
+		*isLastOfNote = endsNote[slot];
+		return blocks[slot];
+	}
+	// consumer: hand the block obtained from getReadSlot back to the producer.
+	void release() {
+		fifo.finishedRead(1);
+	}
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "SimdKernel.h"
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#else
+	#include <cpuid.h>
+#endif
+
+namespace kernel {
+namespace simd {
+
+	static void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+#if defined(_MSC_VER)
+		__cpuidex((int*)regs, leaf, subleaf);
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	// which register sets the OS saves on a context switch (XCR0). Only valid if cpuid reports OSXSAVE.
+	static unsigned long long enabledRegisterSets() {
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned lo, hi;
+		__asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return ((unsigned long long)hi << 32) | lo;
+#endif
+	}
+
+	unsigned detectSupportedBackends(Backend backends[SIMD_MAX_BACKENDS]) {
+		Backend sse = { "sse", 4, &renderPartialLanesSse, &evaluateSharedEnvelopesSse };
+		Backend avx2 = { "avx2", 8, &renderPartialLanesAvx2, &evaluateSharedEnvelopesAvx2 };
+		// every x86-64 processor has SSE2
+		unsigned numBackends = 0;
+		backends[numBackends++] = sse;
+		unsigned regs[4];
+		cpuid(0, 0, regs);
+		unsigned maxLeaf = regs[0];
+		cpuid(1, 0, regs);
+		bool hasOsxsave = (regs[2] >> 27) & 1;
+		bool hasAvx = (regs[2] >> 28) & 1;
+		if (!hasOsxsave || !hasAvx || maxLeaf < 7) {
+			return numBackends;
+		}
+		unsigned long long xcr0 = enabledRegisterSets();
+		// SSE + AVX state; then also the AVX-512 opmask and upper zmm state
+		bool osSavesYmm = (xcr0 & 0x6) == 0x6;
+		bool osSavesZmm = (xcr0 & 0xe6) == 0xe6;
+		cpuid(7, 0, regs);
+		bool hasAvx2 = (regs[1] >> 5) & 1;
+		if (hasAvx2 && osSavesYmm) {
+			backends[numBackends++] = avx2;
+		}
+#if SIMD_HAS_AVX512
+		bool hasAvx512f = (regs[1] >> 16) & 1;
+		if (hasAvx512f && osSavesZmm) {
+			Backend avx512 = { "avx512", 16, &renderPartialLanesAvx512, &evaluateSharedEnvelopesAvx512 };
+			backends[numBackends++] = avx512;
+		}
+#endif
+		return numBackends;
+	}
+
+	Backend detectBestBackend() {
+		Backend backends[SIMD_MAX_BACKENDS];
+		unsigned numBackends = detectSupportedBackends(backends);
+		return backends[numBackends - 1];
+	}
+
+}
+}
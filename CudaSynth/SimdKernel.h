@@ -0,0 +1,173 @@
+#ifndef SIMDKERNEL_H
+#define SIMDKERNEL_H
+
+#include "defines.h"
+
+// Vectorized CPU implementation of the per-sample part of computePartialOutput (see kernel.cu).
+// Each SIMD lane evaluates a different partial of the same voice, so one instruction advances
+//   4 (SSE), 8 (AVX2) or 16 (AVX-512) partials at once.
+// The per-block setup (partialAtBlockStart) stays scalar: kernel.cu runs it for each partial,
+//   then transposes the resulting coefficients into a PartialLanes and hands that to renderPartialLanes.
+//
+// Tolerance: the lanes use a polynomial sin/cos and sum the partials in a different order than the scalar path,
+//   so samples are not bit-identical. Each partial's output stays within SIMD_KERNEL_TOLERANCE
+//   (absolute, relative to full scale) of the scalar path, as long as its phase stays below 2^20 radians
+//   (e.g. 10 seconds of a 16 kHz partial); past that, neither path is accurate anyway.
+#define SIMD_KERNEL_TOLERANCE 2e-5f
+// The rotator oscillator (setRotatorEnabled) does not round the phase to a float at every sample the way the
+//   scalar path does, so it strays further from it: by up to SIMD_ROTATOR_TOLERANCE late into a note, when the phase
+//   is large. Compared to the exact phase, it is as accurate as the scalar path.
+#define SIMD_ROTATOR_TOLERANCE 1e-3f
+// Both tolerances hold at full audio rate (setControlInterval(1)). At control rate, each partial's gain in each channel
+//   follows a straight line between the control points (except across the corners between envelope segments,
+//   which are evaluated at every sample), which strays from an LFO by about depth*(2*pi*freq*interval/SAMPLE_RATE)^2/8.
+// samples between two re-seedings of the rotator from the exact phase. Longer intervals let rounding errors build up.
+#define ROTATOR_SEED_INTERVAL 64
+
+// the widest instruction set supported (AVX-512)
+#define SIMD_MAX_LANES 16
+// the number of instruction sets there is an implementation for (SSE, AVX2 and AVX-512)
+#define SIMD_MAX_BACKENDS 3
+
+// AVX-512 intrinsics need Visual Studio 2017 or newer (any GCC / Clang will do).
+#if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1910)
+	#define SIMD_HAS_AVX512 1
+#else
+	#define SIMD_HAS_AVX512 0
+#endif
+
+namespace kernel {
+namespace simd {
+
+	// Each field holds one value per lane; lane i describes the i-th partial of the group.
+	// Lanes past the number of partials in the group must be zeroed, which renders silence.
+
+	// Sinusoidal: mag(t)*sin(phase(t))
+	struct SinusoidLanes {
+		float mag_c0[SIMD_MAX_LANES], mag_c1[SIMD_MAX_LANES];
+		float phase_c0[SIMD_MAX_LANES], phase_c1[SIMD_MAX_LANES], phase_c2[SIMD_MAX_LANES];
+	};
+
+	// ADSRState: two line segments in terms of the envelope position P.
+	struct ADSRLanes {
+		float P[SIMD_MAX_LANES], clampP[SIMD_MAX_LANES];
+		// position at which the second segment takes over
+		float switchP[SIMD_MAX_LANES];
+		float line0_invLength[SIMD_MAX_LANES];
+		float line0_c0[SIMD_MAX_LANES], line0_c1[SIMD_MAX_LANES];
+		float line1_c0[SIMD_MAX_LANES], line1_c1[SIMD_MAX_LANES];
+	};
+
+	// ADSRLFOEnvelopeState (the LFO only needs its sinusoid once the block has started)
+	struct ADSRLFOLanes {
+		ADSRLanes adsr;
+		SinusoidLanes lfo;
+	};
+
+	struct FilterLanes {
+		ADSRLanes shift;
+		float breakpointBeginTime[FILTER_MAX_BREAKPOINTS_PER_BLOCK][SIMD_MAX_LANES];
+		float breakpointSlope[FILTER_MAX_BREAKPOINTS_PER_BLOCK][SIMD_MAX_LANES];
+		// most breakpoints used by any lane of the group
+		unsigned numBreakpoints;
+		float c0[SIMD_MAX_LANES], c1[SIMD_MAX_LANES];
+		float freq_c0[SIMD_MAX_LANES], freq_c1[SIMD_MAX_LANES];
+	};
+
+	struct DelayLanes {
+		ADSRLFOLanes spaceBetweenEchoes;
+		ADSRLFOLanes amplitudeLostPerEcho;
+	};
+
+	// The envelopes that every partial of the voice shares (see SharedEnvelope in kernel.cu), evaluated once for the whole voice
+	//   rather than in every lane of every group. evaluateSharedEnvelopes fills in their values from their states,
+	//   using the lanes for consecutive samples, so the values come out exactly as a lane of renderPartialLanes would compute them.
+	// The one exception is the rotator (setRotatorEnabled): shared LFOs always use sin, which is the more accurate of the two.
+	struct SharedEnvelopeLanes {
+		bool isVolumeShared, isStereoPanShared, isFilterShiftShared;
+		// the state of each shared envelope, the same in every lane
+		ADSRLFOLanes volumeEnvelope;
+		ADSRLFOLanes stereoPanEnvelope;
+		ADSRLanes filterShift;
+		// the values at each sample of the block and at its end (BUFFER_BLOCK_SIZE): the volume envelope's product,
+		//   the cosine and sine of the pan angle and the filter's shift. Filled a whole vector at a time, hence the padding.
+		float volumeAtIdx[BUFFER_BLOCK_SIZE + SIMD_MAX_LANES];
+		float panCosAtIdx[BUFFER_BLOCK_SIZE + SIMD_MAX_LANES], panSinAtIdx[BUFFER_BLOCK_SIZE + SIMD_MAX_LANES];
+		float filterShiftAtIdx[BUFFER_BLOCK_SIZE + SIMD_MAX_LANES];
+	};
+
+	// What a group of partials has to evaluate at every sample this block, as bits of PartialLanes::features.
+	// A feature is set if any lane of the group needs it. renderPartialLanes has a variant of its sample loop
+	//   for each combination, so that the features left out cost nothing (and the output stays exactly the same).
+	enum LaneFeature {
+		// a volume LFO has some depth (otherwise the volume is its ADSR alone)
+		VolumeLfoFeature = 1 << 0,
+		// the pan moves (otherwise its sin and cos are evaluated once for the block)
+		PanMotionFeature = 1 << 1,
+		// the filter slopes over the frequencies the partial sweeps (otherwise it is a constant gain, and its shift is never needed)
+		FilterSlopeFeature = 1 << 2,
+		// the partials' echoes are audible and scattered from every sample (see mixEchoes in kernel.cu)
+		ScatterEchoesFeature = 1 << 3,
+		AllLaneFeatures = (1 << 4) - 1
+	};
+
+	// everything computePartialOutput needs to render a group of partials for one block.
+	struct PartialLanes {
+		SinusoidLanes sinusoid;
+		// set when every lane plays an exact harmonic of the fundamental at a constant frequency over the block.
+		// The rotator then advances lane i by harmonicStep (e^(i*phase_c1), computed with the Chebyshev recurrence
+		//   in kernel.cu), and needs neither the chirp nor re-seeding.
+		bool isHarmonic;
+		float harmonicStepRe[SIMD_MAX_LANES], harmonicStepIm[SIMD_MAX_LANES];
+		ADSRLFOLanes volumeEnvelope;
+		ADSRLFOLanes stereoPanEnvelope;
+		FilterLanes filter;
+		DelayLanes delay;
+		// LaneFeature bits
+		unsigned features;
+		float level[SIMD_MAX_LANES];
+		// if not NULL, the envelopes it marks as shared are taken from it instead of from the lanes above
+		const SharedEnvelopeLanes *shared;
+		// samples between two evaluations of the envelopes, LFOs, filter and pan, whose gain for each channel is interpolated
+		//   linearly in between: a power of two up to MAX_CONTROL_INTERVAL. At 1 (audio rate), nothing is interpolated.
+		// The echoes are always scattered at audio rate, and only audio rate has a variant for every combination of features.
+		unsigned controlInterval;
+	};
+
+	// Render one block of the partials in lanes (numLanes of them) and add their output (plus echoes, with ScatterEchoesFeature)
+	//   into the circular sampleBuffer of bufferLen frames, starting at frame baseIdx.
+	// isFirstGroup must be set for the group holding partial 0: it also clears the previous block's frames,
+	//   just like reduceOutputs does for partial 0.
+	typedef void (*RenderPartialLanesFn)(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup, bool useRotator);
+
+	void renderPartialLanesSse(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup, bool useRotator);
+	void renderPartialLanesAvx2(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup, bool useRotator);
+#if SIMD_HAS_AVX512
+	void renderPartialLanesAvx512(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup, bool useRotator);
+#endif
+
+	// Fill in the values of the envelopes that shared marks as shared, for one block.
+	typedef void (*EvaluateSharedEnvelopesFn)(SharedEnvelopeLanes *shared);
+
+	void evaluateSharedEnvelopesSse(SharedEnvelopeLanes *shared);
+	void evaluateSharedEnvelopesAvx2(SharedEnvelopeLanes *shared);
+#if SIMD_HAS_AVX512
+	void evaluateSharedEnvelopesAvx512(SharedEnvelopeLanes *shared);
+#endif
+
+	struct Backend {
+		const char *name;
+		// number of partials per PartialLanes
+		unsigned numLanes;
+		RenderPartialLanesFn render;
+		EvaluateSharedEnvelopesFn evaluateShared;
+	};
+	// every implementation this processor (and OS) supports, from the narrowest to the widest; returns how many.
+	// Queries cpuid, so call it once and keep the result.
+	unsigned detectSupportedBackends(Backend backends[SIMD_MAX_BACKENDS]);
+	// the widest implementation this processor (and OS) supports. Queries cpuid, so call it once and keep the result.
+	Backend detectBestBackend();
+}
+}
+
+#endif
@@ -0,0 +1,73 @@
+// AVX2 implementation of renderPartialLanes: 8 partials per instruction.
+// Only called once detectBestBackend() has checked that the processor supports AVX2.
+#if defined(__clang__)
+	#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC target("avx2")
+#endif
+#include <immintrin.h>
+
+namespace kernel {
+namespace simd {
+namespace avx2 {
+
+	struct FloatVec {
+		enum { WIDTH = 8 };
+		typedef __m256 Mask;
+		__m256 v;
+		FloatVec() {}
+		FloatVec(__m256 v) : v(v) {}
+		explicit FloatVec(float f) : v(_mm256_set1_ps(f)) {}
+		static FloatVec load(const float *src) { return _mm256_loadu_ps(src); }
+		void store(float *dest) const { _mm256_storeu_ps(dest, v); }
+	};
+	struct IntVec {
+		__m256i v;
+		IntVec(__m256i v) : v(v) {}
+		void store(int *dest) const { _mm256_storeu_si256((__m256i*)dest, v); }
+	};
+
+	static inline FloatVec operator+(FloatVec a, FloatVec b) { return _mm256_add_ps(a.v, b.v); }
+	static inline FloatVec operator-(FloatVec a, FloatVec b) { return _mm256_sub_ps(a.v, b.v); }
+	static inline FloatVec operator*(FloatVec a, FloatVec b) { return _mm256_mul_ps(a.v, b.v); }
+	static inline FloatVec min(FloatVec a, FloatVec b) { return _mm256_min_ps(a.v, b.v); }
+	static inline FloatVec max(FloatVec a, FloatVec b) { return _mm256_max_ps(a.v, b.v); }
+	static inline __m256 operator>=(FloatVec a, FloatVec b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+	static inline FloatVec select(__m256 mask, FloatVec ifTrue, FloatVec ifFalse) {
+		return _mm256_blendv_ps(ifFalse.v, ifTrue.v, mask);
+	}
+
+	static inline IntVec roundToInt(FloatVec a) { return _mm256_cvtps_epi32(a.v); }
+	static inline IntVec truncToInt(FloatVec a) { return _mm256_cvttps_epi32(a.v); }
+	static inline IntVec operator&(IntVec a, int b) { return _mm256_and_si256(a.v, _mm256_set1_epi32(b)); }
+	static inline IntVec operator+(IntVec a, int b) { return _mm256_add_epi32(a.v, _mm256_set1_epi32(b)); }
+	static inline __m256 isZero(IntVec a) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, _mm256_setzero_si256())); }
+	// negate the lanes of x in which bit 1 of bits is set (bits must be 0 or 2)
+	static inline FloatVec flipSignWhere(FloatVec x, IntVec bits) {
+		return _mm256_xor_ps(x.v, _mm256_castsi256_ps(_mm256_slli_epi32(bits.v, 30)));
+	}
+	// x - quadrant*pi/2, computed in double precision
+	static inline FloatVec subtractHalfPiMultiple(FloatVec x, IntVec quadrant) {
+		__m256d halfPi = _mm256_set1_pd(1.57079632679489661923);
+		__m256d lo = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x.v)), _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(quadrant.v)), halfPi));
+		__m256d hi = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x.v, 1)), _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(quadrant.v, 1)), halfPi));
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+	}
+
+}
+}
+}
+
+#include "SimdKernelImpl.h"
+
+void kernel::simd::renderPartialLanesAvx2(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup, bool useRotator) {
+	renderPartialLanes<avx2::FloatVec, avx2::IntVec>(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup, useRotator);
+}
+
+void kernel::simd::evaluateSharedEnvelopesAvx2(SharedEnvelopeLanes *shared) {
+	evaluateSharedEnvelopes<avx2::FloatVec, avx2::IntVec>(shared);
+}
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#endif
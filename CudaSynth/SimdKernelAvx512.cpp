@@ -0,0 +1,86 @@
+// AVX-512 implementation of renderPartialLanes: 16 partials per instruction.
+// Only called once detectBestBackend() has checked that the processor supports AVX-512F.
+#include "SimdKernel.h"
+
+#if SIMD_HAS_AVX512
+
+// AVX-512F brings FMA along, and fusing phase_c0 + idx*phase_c1 rounds large phases differently from the scalar path,
+//   so keep the compiler from contracting multiply-adds.
+#if defined(__clang__)
+	#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+	#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+	#pragma GCC target("avx512f")
+	#pragma GCC optimize("fp-contract=off")
+#endif
+#include <immintrin.h>
+
+namespace kernel {
+namespace simd {
+namespace avx512 {
+
+	struct FloatVec {
+		enum { WIDTH = 16 };
+		typedef __mmask16 Mask;
+		__m512 v;
+		FloatVec() {}
+		FloatVec(__m512 v) : v(v) {}
+		explicit FloatVec(float f) : v(_mm512_set1_ps(f)) {}
+		static FloatVec load(const float *src) { return _mm512_loadu_ps(src); }
+		void store(float *dest) const { _mm512_storeu_ps(dest, v); }
+	};
+	struct IntVec {
+		__m512i v;
+		IntVec(__m512i v) : v(v) {}
+		void store(int *dest) const { _mm512_storeu_si512(dest, v); }
+	};
+
+	static inline FloatVec operator+(FloatVec a, FloatVec b) { return _mm512_add_ps(a.v, b.v); }
+	static inline FloatVec operator-(FloatVec a, FloatVec b) { return _mm512_sub_ps(a.v, b.v); }
+	static inline FloatVec operator*(FloatVec a, FloatVec b) { return _mm512_mul_ps(a.v, b.v); }
+	static inline FloatVec min(FloatVec a, FloatVec b) { return _mm512_min_ps(a.v, b.v); }
+	static inline FloatVec max(FloatVec a, FloatVec b) { return _mm512_max_ps(a.v, b.v); }
+	static inline __mmask16 operator>=(FloatVec a, FloatVec b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ); }
+	static inline FloatVec select(__mmask16 mask, FloatVec ifTrue, FloatVec ifFalse) {
+		return _mm512_mask_blend_ps(mask, ifFalse.v, ifTrue.v);
+	}
+
+	static inline IntVec roundToInt(FloatVec a) { return _mm512_cvtps_epi32(a.v); }
+	static inline IntVec truncToInt(FloatVec a) { return _mm512_cvttps_epi32(a.v); }
+	static inline IntVec operator&(IntVec a, int b) { return _mm512_and_si512(a.v, _mm512_set1_epi32(b)); }
+	static inline IntVec operator+(IntVec a, int b) { return _mm512_add_epi32(a.v, _mm512_set1_epi32(b)); }
+	static inline __mmask16 isZero(IntVec a) { return _mm512_testn_epi32_mask(a.v, a.v); }
+	// negate the lanes of x in which bit 1 of bits is set (bits must be 0 or 2)
+	static inline FloatVec flipSignWhere(FloatVec x, IntVec bits) {
+		return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(x.v), _mm512_slli_epi32(bits.v, 30)));
+	}
+	// x - quadrant*pi/2, computed in double precision
+	static inline FloatVec subtractHalfPiMultiple(FloatVec x, IntVec quadrant) {
+		__m512d halfPi = _mm512_set1_pd(1.57079632679489661923);
+		__m256 xHi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x.v), 1));
+		__m256i quadrantHi = _mm512_extracti64x4_epi64(quadrant.v, 1);
+		__m512d lo = _mm512_sub_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(x.v)), _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(quadrant.v)), halfPi));
+		__m512d hi = _mm512_sub_pd(_mm512_cvtps_pd(xHi), _mm512_mul_pd(_mm512_cvtepi32_pd(quadrantHi), halfPi));
+		__m512d joined = _mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(lo))), _mm256_castps_pd(_mm512_cvtpd_ps(hi)), 1);
+		return _mm512_castpd_ps(joined);
+	}
+
+}
+}
+}
+
+#include "SimdKernelImpl.h"
+
+void kernel::simd::renderPartialLanesAvx512(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup, bool useRotator) {
+	renderPartialLanes<avx512::FloatVec, avx512::IntVec>(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup, useRotator);
+}
+
+void kernel::simd::evaluateSharedEnvelopesAvx512(SharedEnvelopeLanes *shared) {
+	evaluateSharedEnvelopes<avx512::FloatVec, avx512::IntVec>(shared);
+}
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#endif
+
+#endif
@@ -0,0 +1,452 @@
+#ifndef SIMDKERNELIMPL_H
+#define SIMDKERNELIMPL_H
+
+// The body of renderPartialLanes, written once against an abstract vector type.
+// Each SimdKernel<ISA>.cpp defines FloatVec / IntVec / MaskVec for its instruction set in its own namespace,
+//   plus the free functions used below, then includes this file and instantiates renderPartialLanes.
+// Everything here must stay a template (or otherwise internal to the including file): a plain inline function
+//   compiled for AVX2 in one translation unit could otherwise be picked by the linker for a machine without it.
+//
+// The arithmetic mirrors the scalar classes in kernel.cu operation for operation, so that the only
+//   differences come from sin/cos and from the order in which the partials are summed.
+
+#include "SimdKernel.h"
+
+namespace kernel {
+namespace simd {
+
+	// sin and cos of x, to within a few ulp.
+	// The reduction to [-pi/4, pi/4] is done in double precision, since partial phases grow large over a note.
+	template <class F, class I> static inline void sinCosVec(F x, F *sinOut, F *cosOut) {
+		I quadrant = roundToInt(x * F(0.63661977236758134f));
+		F r = subtractHalfPiMultiple(x, quadrant);
+		F z = r*r;
+		// minimax polynomials for |r| <= pi/4 (as used by cephes' sinf and cosf)
+		F sinR = r + r*z*(F(-1.6666654611e-1f) + z*(F(8.3321608736e-3f) + z*F(-1.9515295891e-4f)));
+		F cosR = F(1.f) - F(0.5f)*z + z*z*(F(4.166664568298827e-2f) + z*(F(-1.388731625493765e-3f) + z*F(2.443315711809948e-5f)));
+		// sin(r + q*pi/2) cycles through sin, cos, -sin, -cos
+		typename F::Mask isEven = isZero(quadrant & 1);
+		*sinOut = flipSignWhere(select(isEven, sinR, cosR), quadrant & 2);
+		*cosOut = flipSignWhere(select(isEven, cosR, sinR), (quadrant + 1) & 2);
+	}
+
+	template <class F, class I> static inline F sinVec(F x) {
+		F s, c;
+		sinCosVec<F, I>(x, &s, &c);
+		return s;
+	}
+
+	template <class F, class I> struct SinusoidVec {
+		F mag_c0, mag_c1, phase_c0, phase_c1, phase_c2;
+		explicit SinusoidVec(const SinusoidLanes &l)
+			: mag_c0(F::load(l.mag_c0)), mag_c1(F::load(l.mag_c1)),
+			  phase_c0(F::load(l.phase_c0)), phase_c1(F::load(l.phase_c1)), phase_c2(F::load(l.phase_c2)) {}
+		F phaseAtIdx(F idx) const {
+			return phase_c0 + idx*(phase_c1 + idx*phase_c2);
+		}
+		F magAtIdx(F idx) const {
+			return mag_c0 + idx*mag_c1;
+		}
+		F valueAtIdx(F idx) const {
+			return magAtIdx(idx)*sinVec<F, I>(phaseAtIdx(idx));
+		}
+		F freqAtIdx(F idx) const {
+			return F(2.f)*phase_c2*idx + phase_c1;
+		}
+	};
+
+	// Recursive oscillator: instead of evaluating sin(phase(n)) at every sample, advance the phasor z = e^(i*phase(n))
+	//   by complex multiplication. The phase is quadratic (a linear chirp), so the step between two samples,
+	//   phase(n+1) - phase(n) = phase_c1 + phase_c2*(2n+1), is itself a phasor w that turns by e^(i*2*phase_c2) per sample.
+	// Each sample then costs two complex multiplications instead of a range reduction and two polynomials.
+	// Rounding errors in w add up in z roughly quadratically, so z and w are re-seeded from the exact phase
+	//   every ROTATOR_SEED_INTERVAL samples (which also renormalizes their amplitude).
+	template <class F, class I> struct RotatorVec {
+		F re, im, stepRe, stepIm, chirpRe, chirpIm;
+		explicit RotatorVec(const SinusoidVec<F, I> &sinusoid) {
+			sinCosVec<F, I>(F(2.f)*sinusoid.phase_c2, &chirpIm, &chirpRe);
+		}
+		// restart from the exact phase (and phase step) at sample idx
+		void seed(const SinusoidVec<F, I> &sinusoid, F idx) {
+			sinCosVec<F, I>(sinusoid.phaseAtIdx(idx), &im, &re);
+			sinCosVec<F, I>(sinusoid.phase_c1 + sinusoid.phase_c2*(F(2.f)*idx + F(1.f)), &stepIm, &stepRe);
+		}
+		// sin(phase) at the current sample; then move on to the next one
+		F next() {
+			F value = im;
+			F nextRe = re*stepRe - im*stepIm;
+			im = re*stepIm + im*stepRe;
+			re = nextRe;
+			F nextStepRe = stepRe*chirpRe - stepIm*chirpIm;
+			stepIm = stepRe*chirpIm + stepIm*chirpRe;
+			stepRe = nextStepRe;
+			return value;
+		}
+	};
+
+	// A sinusoid, evaluated either with sin at every sample or (UseRotator) with a RotatorVec.
+	// valueAtIdx must be called for every sample of the block, in order.
+	template <class F, class I, bool UseRotator> struct OscillatorVec {
+		SinusoidVec<F, I> sinusoid;
+		RotatorVec<F, I> rotator;
+		explicit OscillatorVec(const SinusoidLanes &l) : sinusoid(l), rotator(sinusoid) {}
+		explicit OscillatorVec(const PartialLanes &l) : sinusoid(l.sinusoid), rotator(sinusoid) {}
+		F valueAtIdx(F idx, unsigned sampleIdx) {
+			if (!UseRotator) {
+				return sinusoid.valueAtIdx(idx);
+			}
+			if (sampleIdx % ROTATOR_SEED_INTERVAL == 0) {
+				rotator.seed(sinusoid, idx);
+			}
+			return sinusoid.magAtIdx(idx) * rotator.next();
+		}
+	};
+
+	template <class F> struct ADSRVec {
+		F P, clampP, switchP, line0_invLength, line0_c0, line0_c1, line1_c0, line1_c1;
+		explicit ADSRVec(const ADSRLanes &l)
+			: P(F::load(l.P)), clampP(F::load(l.clampP)), switchP(F::load(l.switchP)), line0_invLength(F::load(l.line0_invLength)),
+			  line0_c0(F::load(l.line0_c0)), line0_c1(F::load(l.line0_c1)),
+			  line1_c0(F::load(l.line1_c0)), line1_c1(F::load(l.line1_c1)) {}
+		F valueAtIdx(F idx) const {
+			F pIdx = min(P + idx*line0_invLength, clampP);
+			return select(pIdx >= switchP, line1_c0 + pIdx*line1_c1, line0_c0 + pIdx*line0_c1);
+		}
+	};
+
+	// OscillatorVec for a sinusoid of constant frequency whose step phasor is already known (PartialLanes::isHarmonic).
+	// Without the chirp, rounding errors in z only grow linearly, so seeding it once per block is enough.
+	template <class F, class I> struct HarmonicOscillatorVec {
+		SinusoidVec<F, I> sinusoid;
+		F re, im, stepRe, stepIm;
+		explicit HarmonicOscillatorVec(const PartialLanes &l)
+			: sinusoid(l.sinusoid), stepRe(F::load(l.harmonicStepRe)), stepIm(F::load(l.harmonicStepIm)) {
+			sinCosVec<F, I>(sinusoid.phase_c0, &im, &re);
+		}
+		F valueAtIdx(F idx, unsigned /*sampleIdx*/) {
+			F value = sinusoid.magAtIdx(idx) * im;
+			F nextRe = re*stepRe - im*stepIm;
+			im = re*stepIm + im*stepRe;
+			re = nextRe;
+			return value;
+		}
+	};
+
+	// like OscillatorVec, productAtIdx / sumAtIdx must be called once for every sample of the block, in order.
+	template <class F, class I, bool UseRotator> struct ADSRLFOVec {
+		ADSRVec<F> adsr;
+		OscillatorVec<F, I, UseRotator> lfo;
+		explicit ADSRLFOVec(const ADSRLFOLanes &l) : adsr(l.adsr), lfo(l.lfo) {}
+		F productAtIdx(F idx, unsigned sampleIdx) {
+			return adsr.valueAtIdx(idx) * (F(1.f) + lfo.valueAtIdx(idx, sampleIdx));
+		}
+		F sumAtIdx(F idx, unsigned sampleIdx) {
+			return adsr.valueAtIdx(idx) + lfo.valueAtIdx(idx, sampleIdx);
+		}
+	};
+
+	template <class F> struct FilterVec {
+		ADSRVec<F> shift;
+		F breakpointBeginTime[FILTER_MAX_BREAKPOINTS_PER_BLOCK], breakpointSlope[FILTER_MAX_BREAKPOINTS_PER_BLOCK];
+		unsigned numBreakpoints;
+		F c0, c1, freq_c0, freq_c1;
+		explicit FilterVec(const FilterLanes &l)
+			: shift(l.shift), numBreakpoints(l.numBreakpoints), c0(F::load(l.c0)), c1(F::load(l.c1)),
+			freq_c0(F::load(l.freq_c0)), freq_c1(F::load(l.freq_c1)) {
+			for (unsigned i = 0; i < numBreakpoints; ++i) {
+				breakpointBeginTime[i] = F::load(l.breakpointBeginTime[i]);
+				breakpointSlope[i] = F::load(l.breakpointSlope[i]);
+			}
+		}
+		// shiftValue is shift.valueAtIdx(idx), unless it was evaluated once for the voice (see SharedEnvelopeLanes)
+		F valueAtIdx(F idx, F shiftValue) const {
+			F w = freq_c0 + idx*freq_c1;
+			w = w - shiftValue;
+			F sum = c0 + c1*w;
+			for (unsigned i = 0; i < numBreakpoints; ++i) {
+				sum = sum + breakpointSlope[i] * max(w, breakpointBeginTime[i]);
+			}
+			return sum;
+		}
+	};
+
+	template <class F> static inline F antiAliasedVolumeForFreqVec(F angularFreq) {
+		float falloffWidth = ANTI_ALIAS_FALLOFF_WIDTH;
+		float invFalloffWidth = 1.f / ANTI_ALIAS_FALLOFF_WIDTH;
+		float falloffEnd = ANTI_ALIAS_FALLOFF_END;
+		float falloffStart = falloffEnd - falloffWidth;
+
+		F clamped = min(F(falloffEnd), max(F(falloffStart), angularFreq));
+		return F(1.f) - (clamped - F(falloffStart)) * F(invFalloffWidth);
+	}
+
+	template <class F, class I> static void evaluateSharedEnvelopes(SharedEnvelopeLanes *shared) {
+		ADSRLFOVec<F, I, false> volumeEnvelope(shared->volumeEnvelope);
+		ADSRLFOVec<F, I, false> stereoPanEnvelope(shared->stereoPanEnvelope);
+		const ADSRVec<F> filterShift(shared->filterShift);
+		// lane i evaluates sample sampleIdx + i
+		float offsets[F::WIDTH];
+		for (int lane = 0; lane < F::WIDTH; ++lane) {
+			offsets[lane] = (float)lane;
+		}
+		const F laneOffsets = F::load(offsets);
+		// up to and including the end of the block, where the last control interval ends
+		for (unsigned sampleIdx = 0; sampleIdx <= BUFFER_BLOCK_SIZE; sampleIdx += F::WIDTH) {
+			F idx = F((float)sampleIdx) + laneOffsets;
+			if (shared->isVolumeShared) {
+				volumeEnvelope.productAtIdx(idx, sampleIdx).store(&shared->volumeAtIdx[sampleIdx]);
+			}
+			if (shared->isStereoPanShared) {
+				F angle = F(PIf / 4) * (F(1.f) + stereoPanEnvelope.sumAtIdx(idx, sampleIdx));
+				F sinAng, cosAng;
+				sinCosVec<F, I>(angle, &sinAng, &cosAng);
+				cosAng.store(&shared->panCosAtIdx[sampleIdx]);
+				sinAng.store(&shared->panSinAtIdx[sampleIdx]);
+			}
+			if (shared->isFilterShiftShared) {
+				filterShift.valueAtIdx(idx).store(&shared->filterShiftAtIdx[sampleIdx]);
+			}
+		}
+	}
+
+	// Everything that shapes the amplitude and pan of a group's partials: the volume and pan envelopes, their LFOs and the filter,
+	//   each taken from lanes.shared where it says so.
+	// Only evaluates the LaneFeatures in Features; the others must be off for every lane (see PartialLanes::features).
+	// With UseRotator, the methods must be called for every sample of the block, in order (like OscillatorVec).
+	template <class F, class I, bool UseRotator, unsigned Features> struct ModulatorsVec {
+		const FilterVec<F> filter;
+		ADSRLFOVec<F, I, UseRotator> volumeEnvelope;
+		ADSRLFOVec<F, I, UseRotator> stereoPanEnvelope;
+		const SharedEnvelopeLanes *shared;
+		bool isVolumeShared, isStereoPanShared, isFilterShiftShared;
+		// the pan, without PanMotionFeature
+		F constantPanSin, constantPanCos;
+		explicit ModulatorsVec(const PartialLanes &l)
+			: filter(l.filter), volumeEnvelope(l.volumeEnvelope), stereoPanEnvelope(l.stereoPanEnvelope), shared(l.shared),
+			isVolumeShared(shared != NULL && shared->isVolumeShared), isStereoPanShared(shared != NULL && shared->isStereoPanShared),
+			isFilterShiftShared(shared != NULL && shared->isFilterShiftShared), constantPanSin(0.f), constantPanCos(0.f) {
+			if (!(Features & PanMotionFeature)) {
+				// the same at every sample, so this is what evaluating it at every sample would give
+				movingPanAtIdx(F(0.f), 0, &constantPanSin, &constantPanCos);
+			}
+		}
+		// the product of the anti-aliasing, filter and volume envelopes at idx, for partials at angular frequency freq
+		F envelopeAtIdx(F idx, unsigned sampleIdx, F freq) {
+			F antiAliasEnv = antiAliasedVolumeForFreqVec(freq);
+			// a flat filter's slope is exactly 0, so its value is c0 whatever the frequency and shift
+			F filterEnv = !(Features & FilterSlopeFeature) ? filter.c0
+				: filter.valueAtIdx(idx, isFilterShiftShared ? F(shared->filterShiftAtIdx[sampleIdx]) : filter.shift.valueAtIdx(idx));
+			F volume;
+			if (isVolumeShared) {
+				volume = F(shared->volumeAtIdx[sampleIdx]);
+			} else if (Features & VolumeLfoFeature) {
+				volume = volumeEnvelope.productAtIdx(idx, sampleIdx);
+			} else {
+				// an LFO without depth is exactly 0, and adsr*(1 + 0) is the ADSR itself
+				volume = volumeEnvelope.adsr.valueAtIdx(idx);
+			}
+			return antiAliasEnv*filterEnv*volume;
+		}
+		// constant-energy panning, as in computePartialOutput
+		void panAtIdx(F idx, unsigned sampleIdx, F *sinAng, F *cosAng) {
+			if (Features & PanMotionFeature) {
+				movingPanAtIdx(idx, sampleIdx, sinAng, cosAng);
+			} else {
+				*sinAng = constantPanSin;
+				*cosAng = constantPanCos;
+			}
+		}
+		void movingPanAtIdx(F idx, unsigned sampleIdx, F *sinAng, F *cosAng) {
+			if (isStereoPanShared) {
+				*cosAng = F(shared->panCosAtIdx[sampleIdx]);
+				*sinAng = F(shared->panSinAtIdx[sampleIdx]);
+			} else {
+				F angle = F(PIf / 4) * (F(1.f) + stereoPanEnvelope.sumAtIdx(idx, sampleIdx));
+				sinCosVec<F, I>(angle, sinAng, cosAng);
+			}
+		}
+		// the gain of each channel at idx: the level, the envelopes and the pan together
+		void channelGainsAtIdx(F idx, unsigned sampleIdx, F freq, F level, F *gainL, F *gainR) {
+			F gain = level*envelopeAtIdx(idx, sampleIdx, freq);
+			F sinAng, cosAng;
+			panAtIdx(idx, sampleIdx, &sinAng, &cosAng);
+			*gainL = gain*cosAng;
+			*gainR = gain*sinAng;
+		}
+	};
+
+	// Marks in hasCorner the control intervals within which adsr, in any of its first numLanes lanes, moves on to its second segment
+	//   or comes to rest at its clamp. A straight line between the control points would cut across that corner,
+	//   stretching a segment of a few samples (such as the default release) over the whole interval.
+	static inline void markAdsrCorners(const ADSRLanes &adsr, unsigned numLanes, unsigned controlInterval, bool *hasCorner) {
+		for (unsigned lane = 0; lane < numLanes; ++lane) {
+			float invLength = adsr.line0_invLength[lane];
+			if (!(invLength > 0.f)) {
+				// the position holds still, so the envelope is one straight line
+				continue;
+			}
+			float cornerPs[2] = { adsr.switchP[lane], adsr.clampP[lane] };
+			for (int corner = 0; corner < 2; ++corner) {
+				float cornerIdx = (cornerPs[corner] - adsr.P[lane]) / invLength;
+				if (cornerIdx > 0.f && cornerIdx < (float)BUFFER_BLOCK_SIZE) {
+					hasCorner[(unsigned)cornerIdx / controlInterval] = true;
+				}
+			}
+		}
+	}
+
+	// Osc is the oscillator of the partials themselves: OscillatorVec<F, I, UseRotator> or HarmonicOscillatorVec.
+	// AtControlRate evaluates the modulators every lanes->controlInterval samples instead of at every sample,
+	//   except in the intervals where one of their ADSRs turns a corner (see markAdsrCorners), which are evaluated at every sample.
+	// Features are the LaneFeatures to evaluate; lanes->features must not have any others.
+	template <class F, class I, bool UseRotator, class Osc, bool AtControlRate, unsigned Features> static void renderPartialLanesWith(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup) {
+		Osc sinusoid(*lanes);
+		// the rotators can only advance their LFOs one sample at a time
+		ModulatorsVec<F, I, UseRotator && !AtControlRate, Features> modulators(*lanes);
+		ADSRLFOVec<F, I, UseRotator> spaceBetweenEchoes(lanes->delay.spaceBetweenEchoes);
+		ADSRLFOVec<F, I, UseRotator> amplitudeLostPerEcho(lanes->delay.amplitudeLostPerEcho);
+		const F level = F::load(lanes->level);
+
+		// at control rate: the gains of each channel at the start of the current control interval, their change per sample,
+		//   and the gains at its end (where the next one starts)
+		unsigned controlInterval = lanes->controlInterval;
+		const F invControlInterval(1.f / controlInterval);
+		F gainL(0.f), gainR(0.f), gainStepL(0.f), gainStepR(0.f), endGainL(0.f), endGainR(0.f);
+		// the control intervals evaluated at every sample, and whether the current one is
+		bool hasCorner[BUFFER_BLOCK_SIZE / 2];
+		bool isCornerInterval = false;
+		if (AtControlRate) {
+			modulators.channelGainsAtIdx(F(0.f), 0, sinusoid.sinusoid.freqAtIdx(F(0.f)), level, &endGainL, &endGainR);
+			for (unsigned interval = 0; interval < BUFFER_BLOCK_SIZE / controlInterval; ++interval) {
+				hasCorner[interval] = false;
+			}
+			markAdsrCorners(lanes->volumeEnvelope.adsr, numLanes, controlInterval, hasCorner);
+			if (lanes->features & PanMotionFeature) {
+				markAdsrCorners(lanes->stereoPanEnvelope.adsr, numLanes, controlInterval, hasCorner);
+			}
+			if (lanes->features & FilterSlopeFeature) {
+				markAdsrCorners(lanes->filter.shift, numLanes, controlInterval, hasCorner);
+			}
+		}
+
+		float outputL[F::WIDTH], outputR[F::WIDTH];
+		float ampLossPerEcho[F::WIDTH];
+		int delayPerEchoInSamples[F::WIDTH];
+		for (unsigned sampleIdx = 0; sampleIdx < BUFFER_BLOCK_SIZE; ++sampleIdx) {
+			F idx((float)sampleIdx);
+			F sinusoidValue = sinusoid.valueAtIdx(idx, sampleIdx);
+
+			if (AtControlRate) {
+				unsigned offset = sampleIdx & (controlInterval - 1);
+				if (offset == 0) {
+					gainL = endGainL;
+					gainR = endGainR;
+					unsigned endIdx = sampleIdx + controlInterval;
+					F endIdxVec((float)endIdx);
+					modulators.channelGainsAtIdx(endIdxVec, endIdx, sinusoid.sinusoid.freqAtIdx(endIdxVec), level, &endGainL, &endGainR);
+					gainStepL = (endGainL - gainL)*invControlInterval;
+					gainStepR = (endGainR - gainR)*invControlInterval;
+					isCornerInterval = hasCorner[sampleIdx / controlInterval];
+				}
+				if (isCornerInterval) {
+					F exactGainL, exactGainR;
+					modulators.channelGainsAtIdx(idx, sampleIdx, sinusoid.sinusoid.freqAtIdx(idx), level, &exactGainL, &exactGainR);
+					(sinusoidValue*exactGainL).store(outputL);
+					(sinusoidValue*exactGainR).store(outputR);
+				} else {
+					F offsetVec((float)offset);
+					(sinusoidValue*(gainL + gainStepL*offsetVec)).store(outputL);
+					(sinusoidValue*(gainR + gainStepR*offsetVec)).store(outputR);
+				}
+			} else {
+				F envelope = modulators.envelopeAtIdx(idx, sampleIdx, sinusoid.sinusoid.freqAtIdx(idx));
+				F unpanned = level*envelope*sinusoidValue;
+				F sinAng, cosAng;
+				modulators.panAtIdx(idx, sampleIdx, &sinAng, &cosAng);
+				(unpanned * cosAng).store(outputL);
+				(unpanned * sinAng).store(outputR);
+			}
+
+			// sum the lanes into the buffer (the scalar path does this in reduceOutputs)
+			float sumL = 0.f, sumR = 0.f;
+			for (int lane = 0; lane < F::WIDTH; ++lane) {
+				sumL += outputL[lane];
+				sumR += outputR[lane];
+			}
+			unsigned absIdx = baseIdx + sampleIdx;
+			if (isFirstGroup) {
+				// zero the previous frame's outputs so the delay effect can fill them
+				unsigned prevIdx = NUM_CH * ((bufferLen + absIdx - BUFFER_BLOCK_SIZE) % bufferLen);
+				sampleBuffer[prevIdx + 0] = 0;
+				sampleBuffer[prevIdx + 1] = 0;
+			}
+			unsigned bufferIdx = NUM_CH * (absIdx % bufferLen);
+			sampleBuffer[bufferIdx + 0] += sumL;
+			sampleBuffer[bufferIdx + 1] += sumR;
+
+			if (Features & ScatterEchoesFeature) {
+				// echoes land at a different offset for every partial, so scatter them one lane at a time
+				truncToInt(spaceBetweenEchoes.productAtIdx(idx, sampleIdx) * F((float)SAMPLE_RATE)).store(delayPerEchoInSamples);
+				amplitudeLostPerEcho.productAtIdx(idx, sampleIdx).store(ampLossPerEcho);
+				for (unsigned lane = 0; lane < numLanes; ++lane) {
+					unsigned delayInSamples = (unsigned)delayPerEchoInSamples[lane];
+					for (unsigned echoVoiceIdx = 1; echoVoiceIdx <= MAX_DELAY_ECHOES; ++echoVoiceIdx) {
+						float curAmp = 1.f - echoVoiceIdx*ampLossPerEcho[lane];
+						if (!(curAmp > 0.f)) {
+							// silent echo: adding it would not change the buffer
+							continue;
+						}
+						unsigned absDelayIdx = absIdx + echoVoiceIdx + echoVoiceIdx * delayInSamples;
+						unsigned delayIdx = NUM_CH * (absDelayIdx % bufferLen);
+						sampleBuffer[delayIdx + 0] += curAmp*outputL[lane];
+						sampleBuffer[delayIdx + 1] += curAmp*outputR[lane];
+					}
+				}
+			}
+		}
+	}
+
+	// Renders with the variant of renderPartialLanesWith at audio rate for the given LaneFeatures,
+	//   counting down from Features until it finds them.
+	template <class F, class I, bool UseRotator, class Osc, unsigned Features> struct AudioRateVariant {
+		static void render(unsigned features, const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup) {
+			if (features == Features) {
+				renderPartialLanesWith<F, I, UseRotator, Osc, false, Features>(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup);
+			} else {
+				AudioRateVariant<F, I, UseRotator, Osc, Features - 1>::render(features, lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup);
+			}
+		}
+	};
+
+	// the last variant left: features can only be 0
+	template <class F, class I, bool UseRotator, class Osc> struct AudioRateVariant<F, I, UseRotator, Osc, 0> {
+		static void render(unsigned /*features*/, const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup) {
+			renderPartialLanesWith<F, I, UseRotator, Osc, false, 0>(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup);
+		}
+	};
+
+	template <class F, class I, bool UseRotator, class Osc> static void renderPartialLanesWithOsc(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup) {
+		if (lanes->controlInterval == 1) {
+			AudioRateVariant<F, I, UseRotator, Osc, AllLaneFeatures>::render(lanes->features, lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup);
+		} else if (lanes->features & ScatterEchoesFeature) {
+			// the modulators only run at the control points, where skipping features saves little, so only the echoes are left out
+			renderPartialLanesWith<F, I, UseRotator, Osc, true, AllLaneFeatures>(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup);
+		} else {
+			renderPartialLanesWith<F, I, UseRotator, Osc, true, AllLaneFeatures & ~ScatterEchoesFeature>(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup);
+		}
+	}
+
+	template <class F, class I> static void renderPartialLanes(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup, bool useRotator) {
+		if (!useRotator) {
+			renderPartialLanesWithOsc<F, I, false, OscillatorVec<F, I, false> >(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup);
+		} else if (lanes->isHarmonic) {
+			renderPartialLanesWithOsc<F, I, true, HarmonicOscillatorVec<F, I> >(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup);
+		} else {
+			renderPartialLanesWithOsc<F, I, true, OscillatorVec<F, I, true> >(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup);
+		}
+	}
+
+}
+}
+
+#endif
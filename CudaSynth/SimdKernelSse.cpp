@@ -0,0 +1,64 @@
+// SSE2 implementation of renderPartialLanes: 4 partials per instruction.
+// SSE2 is part of every x64 processor, so this is the fallback when nothing wider is available.
+#include <emmintrin.h>
+
+namespace kernel {
+namespace simd {
+namespace sse {
+
+	struct FloatVec {
+		enum { WIDTH = 4 };
+		typedef __m128 Mask;
+		__m128 v;
+		FloatVec() {}
+		FloatVec(__m128 v) : v(v) {}
+		explicit FloatVec(float f) : v(_mm_set1_ps(f)) {}
+		static FloatVec load(const float *src) { return _mm_loadu_ps(src); }
+		void store(float *dest) const { _mm_storeu_ps(dest, v); }
+	};
+	struct IntVec {
+		__m128i v;
+		IntVec(__m128i v) : v(v) {}
+		void store(int *dest) const { _mm_storeu_si128((__m128i*)dest, v); }
+	};
+
+	static inline FloatVec operator+(FloatVec a, FloatVec b) { return _mm_add_ps(a.v, b.v); }
+	static inline FloatVec operator-(FloatVec a, FloatVec b) { return _mm_sub_ps(a.v, b.v); }
+	static inline FloatVec operator*(FloatVec a, FloatVec b) { return _mm_mul_ps(a.v, b.v); }
+	static inline FloatVec min(FloatVec a, FloatVec b) { return _mm_min_ps(a.v, b.v); }
+	static inline FloatVec max(FloatVec a, FloatVec b) { return _mm_max_ps(a.v, b.v); }
+	static inline __m128 operator>=(FloatVec a, FloatVec b) { return _mm_cmpge_ps(a.v, b.v); }
+	static inline FloatVec select(__m128 mask, FloatVec ifTrue, FloatVec ifFalse) {
+		return _mm_or_ps(_mm_and_ps(mask, ifTrue.v), _mm_andnot_ps(mask, ifFalse.v));
+	}
+
+	static inline IntVec roundToInt(FloatVec a) { return _mm_cvtps_epi32(a.v); }
+	static inline IntVec truncToInt(FloatVec a) { return _mm_cvttps_epi32(a.v); }
+	static inline IntVec operator&(IntVec a, int b) { return _mm_and_si128(a.v, _mm_set1_epi32(b)); }
+	static inline IntVec operator+(IntVec a, int b) { return _mm_add_epi32(a.v, _mm_set1_epi32(b)); }
+	static inline __m128 isZero(IntVec a) { return _mm_castsi128_ps(_mm_cmpeq_epi32(a.v, _mm_setzero_si128())); }
+	// negate the lanes of x in which bit 1 of bits is set (bits must be 0 or 2)
+	static inline FloatVec flipSignWhere(FloatVec x, IntVec bits) {
+		return _mm_xor_ps(x.v, _mm_castsi128_ps(_mm_slli_epi32(bits.v, 30)));
+	}
+	// x - quadrant*pi/2, computed in double precision
+	static inline FloatVec subtractHalfPiMultiple(FloatVec x, IntVec quadrant) {
+		__m128d halfPi = _mm_set1_pd(1.57079632679489661923);
+		__m128d lo = _mm_sub_pd(_mm_cvtps_pd(x.v), _mm_mul_pd(_mm_cvtepi32_pd(quadrant.v), halfPi));
+		__m128d hi = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(x.v, x.v)), _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(quadrant.v, _MM_SHUFFLE(1, 0, 3, 2))), halfPi));
+		return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+	}
+
+}
+}
+}
+
+#include "SimdKernelImpl.h"
+
+void kernel::simd::renderPartialLanesSse(const PartialLanes *lanes, unsigned numLanes, float *sampleBuffer, unsigned bufferLen, unsigned baseIdx, bool isFirstGroup, bool useRotator) {
+	renderPartialLanes<sse::FloatVec, sse::IntVec>(lanes, numLanes, sampleBuffer, bufferLen, baseIdx, isFirstGroup, useRotator);
+}
+
+void kernel::simd::evaluateSharedEnvelopesSse(SharedEnvelopeLanes *shared) {
+	evaluateSharedEnvelopes<sse::FloatVec, sse::IntVec>(shared);
+}
@@ -0,0 +1,54 @@
+#include "Wavetable.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include "defines.h"
+#include "IfftSynth.h"
+
+namespace kernel {
+
+	void Wavetable::build(unsigned numHarmonics, const float *ampL, const float *ampR, const float *phase) {
+		length = 2;
+		while (length < WAVETABLE_OVERSAMPLING*numHarmonics) {
+			length *= 2;
+		}
+		spectrumRe.assign(length, 0.f);
+		spectrumIm.assign(length, 0.f);
+		// as in ifft::Frame::addPartial: left + i*right share the transform, and a*sin(phase + k*theta) puts
+		//   A*u in bin k and A*conj(u) in bin -k, where A = ampL + i*ampR and u = e^(i*phase)/(2i).
+		// Every harmonic falls exactly on a bin, so no window is needed.
+		for (unsigned h = 0; h < numHarmonics; ++h) {
+			float uRe = 0.5f*sinf(phase[h]);
+			float uIm = -0.5f*cosf(phase[h]);
+			unsigned bin = h + 1;
+			spectrumRe[bin] += ampL[h] * uRe - ampR[h] * uIm;
+			spectrumIm[bin] += ampL[h] * uIm + ampR[h] * uRe;
+			spectrumRe[length - bin] += ampL[h] * uRe + ampR[h] * uIm;
+			spectrumIm[length - bin] += ampR[h] * uRe - ampL[h] * uIm;
+		}
+		ifft::inverseTransform(&spectrumRe[0], &spectrumIm[0], length);
+		samples.resize((length + 3) * NUM_CH);
+		for (unsigned i = 0; i < length + 3; ++i) {
+			unsigned src = (i + length - 1) % length;
+			samples[NUM_CH*i + 0] = spectrumRe[src];
+			samples[NUM_CH*i + 1] = spectrumIm[src];
+		}
+	}
+
+	void Wavetable::valueAt(double position, float *outL, float *outR) const {
+		double index = position*length;
+		unsigned i = std::min((unsigned)index, length - 1);
+		float t = (float)(index - i);
+		// Lagrange weights for the frames at i-1, i, i+1 and i+2
+		float wPrev = -t*(t - 1)*(t - 2)*(1.f / 6);
+		float wCur = (t + 1)*(t - 1)*(t - 2)*0.5f;
+		float wNext = -(t + 1)*t*(t - 2)*0.5f;
+		float wAfter = (t + 1)*t*(t - 1)*(1.f / 6);
+		// samples[0] holds frame -1
+		const float *frames = &samples[NUM_CH*i];
+		*outL = wPrev*frames[0] + wCur*frames[NUM_CH] + wNext*frames[2 * NUM_CH] + wAfter*frames[3 * NUM_CH];
+		*outR = wPrev*frames[1] + wCur*frames[NUM_CH + 1] + wNext*frames[2 * NUM_CH + 1] + wAfter*frames[3 * NUM_CH + 1];
+	}
+
+}
@@ -0,0 +1,34 @@
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+#include <vector>
+
+// One period of a periodic stereo signal made of harmonics of a fundamental, played back at any fundamental frequency.
+// Used for voices in steady state (see SteadyStateCache in kernel.cu): every partial is then an exact harmonic
+//   with constant amplitude and pan, so the voice's output repeats every period.
+// The table is built by inverse FFT from the harmonics themselves, so it holds nothing above the highest one,
+//   and it is read with 4-point Lagrange interpolation.
+
+// minimum table entries per cycle of the highest harmonic. Interpolation errors shrink with the 4th power of this.
+#define WAVETABLE_OVERSAMPLING 32
+
+namespace kernel {
+	class Wavetable {
+		// one period, interleaved by channel, with the last frame repeated before it and the first two after it
+		//   so that interpolation never wraps around.
+		std::vector<float> samples;
+		// scratch space for the spectrum, kept to avoid reallocating on every build
+		std::vector<float> spectrumRe, spectrumIm;
+		// number of frames in one period (a power of two)
+		unsigned length;
+	public:
+		Wavetable() : length(0) {}
+		// one period of ampL[h]*sin(phase[h] + (h+1)*theta) (left) and ampR[h]*sin(phase[h] + (h+1)*theta) (right),
+		//   summed over h < numHarmonics, for theta from 0 to 2*pi.
+		void build(unsigned numHarmonics, const float *ampL, const float *ampR, const float *phase);
+		// the signal at position periods from theta = 0 (0 <= position < 1)
+		void valueAt(double position, float *outL, float *outR) const;
+	};
+}
+
+#endif
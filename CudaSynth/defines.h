@@ -5,21 +5,51 @@
 #ifndef NEVER_USE_CUDA
 #define NEVER_USE_CUDA 1
 #endif
+// set to 1 to always use the scalar CPU code, even on processors with SIMD support
+#ifndef NEVER_USE_SIMD
+#define NEVER_USE_SIMD 0
+#endif
+// once enabled with kernel::setIfftEnabled, voices with at least this many partials are rendered on the CPU
+//   by inverse FFT (see IfftSynth.h) rather than sample by sample. Below it, the SIMD code is about as fast or faster.
+#ifndef IFFT_MIN_PARTIALS
+#define IFFT_MIN_PARTIALS 256
+#endif
+// samples between two evaluations of each partial's envelopes, LFOs, filter and pan by the SIMD code,
+//   which interpolates the resulting gains linearly in between, unless changed with kernel::setControlInterval.
+// 1 evaluates them at every sample.
+#ifndef DEFAULT_CONTROL_INTERVAL
+#define DEFAULT_CONTROL_INTERVAL 16
+#endif
+// the longest control interval allowed. Longer ones smooth over faster changes (e.g. short attacks, fast LFOs).
+#define MAX_CONTROL_INTERVAL 64
 
 // number of audio channels to use (2=stereo)
 // This macro serves to avoid placing magic numbers in our code - it is assumed this will always be 2.
 #define NUM_CH 2
-// Number of partials to include in the sound.
-#define NUM_PARTIALS 16
+// Number of partials to include in the sound unless the preset says otherwise (see ParameterStates::numPartials).
+#define DEFAULT_NUM_PARTIALS 16
+// The most partials a preset may use.
+// This is also the largest thread block the GPU kernel launches, so it may not exceed the device's limit (1024).
+#define MAX_PARTIALS 1024
 
 // The maximum number of notes that can be played simultaneously.
-#define MAX_SIMULTANEOUS_SYNTH_NOTES 2
+// The actual polyphony is chosen at runtime (see kernel::setPolyphony), up to this limit.
+#define MAX_SIMULTANEOUS_SYNTH_NOTES 256
+// The polyphony to use until told otherwise.
+#define DEFAULT_SIMULTANEOUS_SYNTH_NOTES 8
 
 // number of samples to buffer at a time.
 // larger numbers means fewer transfefs between CPU / GPU,
 //   but larger latency
+// Can be overridden at build time (e.g. to benchmark other block sizes).
+#ifndef BUFFER_BLOCK_SIZE
 #define BUFFER_BLOCK_SIZE 512
+#endif
 #define INV_BUFFER_BLOCK_SIZE (1.f / BUFFER_BLOCK_SIZE)
+// number of blocks each voice's fill thread may render ahead of the audio callback.
+// More blocks means more slack before an underrun, but each one adds BUFFER_BLOCK_SIZE samples of latency
+//   to note releases.
+#define RENDER_AHEAD_BLOCKS 2
 // number of threads to use for evaluating *each* partial within the buffer block.
 #define NUM_THREADS_PER_PARTIAL_CPU 1
 #define NUM_THREADS_PER_PARTIAL_GPU BUFFER_BLOCK_SIZE
@@ -38,7 +68,10 @@
 #define DETUNE_NUM_SEEDS 4
 
 // for easier memory management, avoid building piecewise functions out of vectors; use a fixed array
-#define PIECEWISE_MAX_PIECES 8
+#define PIECEWISE_MAX_PIECES 64
+// most breakpoints of the filter envelope evaluated per sample within one block (see FilterState in kernel.cu).
+// Blocks whose frequencies sweep across more breakpoints than this follow the envelope through a selection of them.
+#define FILTER_MAX_BREAKPOINTS_PER_BLOCK 4
 
 #define PI        3.14159265358979323846
 #define PIf       3.14159265358979323846f
@@ -51,6 +84,10 @@
 #define INV_SAMPLE_RATE (1.f/SAMPLE_RATE)
 #define NYQUIST_RATE (0.5f*SAMPLE_RATE)
 #define NYQUIST_RATE_RAD (0.5f*SAMPLE_RATE_RAD)
+// the anti-aliasing envelope fades partials out over ANTI_ALIAS_FALLOFF_WIDTH below Nyquist and mutes them above it.
+// Both are angular frequencies per sample (rad/sample), the units of Sinusoidal::freqAtIdx.
+#define ANTI_ALIAS_FALLOFF_END PIf
+#define ANTI_ALIAS_FALLOFF_WIDTH (4000.f*INV_SAMPLE_RATE)
 
 
 
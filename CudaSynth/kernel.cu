@@ -8,10 +8,15 @@
 #include <assert.h>
 #include <stdlib.h> // for atexit
 #include <mutex>
+#include <atomic>
 #include <thread> // for unique_lock
 #include <random> // for deterministic pseudorandom number generation
+#include <vector>
 
 #include "defines.h"
+#include "SimdKernel.h"
+#include "IfftSynth.h"
+#include "Wavetable.h"
 
 // CUDA has fast sin/cos approximation intrinsics
 // The sacrifice is that denormalized numbers are flushed to zero (should be tolerable)
@@ -25,21 +30,45 @@
 	#define FASTCOSF(x) cosf(x)
 	#define FASTSINCOSF(a, sptr, cptr) sincosf(a, sptr, cptr)
 #endif
+// the longest a voice's sample buffer gets (see requiredSampleBufferLen)
 #define CIRCULAR_BUFFER_LEN MAX_DELAY_EFFECT_LENGTH
 
 namespace kernel {
-	// define statics
-	unsigned ParameterStates::nextUUID(0);
-
 	// forward-declare necessary classes
 	struct SynthVoiceState;
 	struct SynthState;
 	// this is a circular buffer of sample data (interleaved by channel number) stored on the device
 	// It is persistent and lengthy, in order to accomodate the delay effect.
 	SynthState *d_synthState = NULL;
+	// host-side copies of d_synthState->voiceStates (also on the device) and of its length,
+	//   which can only change while every voice lock is held.
+	SynthVoiceState *d_voiceStates = NULL;
+	unsigned numVoiceStates = 0;
+	// the polyphony to allocate on startup
+	unsigned requestedNumVoiceStates = DEFAULT_SIMULTANEOUS_SYNTH_NOTES;
 
-	// When running on the cpu, we need to control concurrent access to the synth state
-	std::mutex synthStateMutex;
+	// When running on the cpu, we need to control concurrent access to the synth state.
+	// Each voice owns its own SynthVoiceState, so there is one lock per voice:
+	//   voices render in parallel, and only contend with the GUI thread (parameter edits) and note starts on the same voice.
+	// Data shared between voices (e.g. the parameter snapshots) is read-only once published.
+	std::mutex voiceStateMutexes[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	// guards first-time initialization of the synth state, which may be triggered from any thread.
+	std::once_flag startupFlag;
+	// serializes changes to the set of voices (setPolyphony) with operations that span every voice.
+	// Always acquired before any of the voiceStateMutexes.
+	std::mutex voicePoolMutex;
+	// the vectorized CPU implementation best suited to this processor (detected on startup),
+	//   and whether to use it rather than the scalar code.
+	simd::Backend cpuBackend;
+	std::atomic<bool> isSimdEnabled(!NEVER_USE_SIMD);
+	// whether the SIMD path advances each partial's sinusoid with a recursive oscillator rather than evaluating sin
+	std::atomic<bool> isRotatorEnabled(true);
+	// samples between evaluations of the modulators in the SIMD path: 1, or a power of two up to MAX_CONTROL_INTERVAL
+	std::atomic<unsigned> controlInterval(DEFAULT_CONTROL_INTERVAL);
+	// whether voices with IFFT_MIN_PARTIALS or more partials are rendered by inverse FFT (see IfftSynth.h)
+	std::atomic<bool> isIfftEnabled(false);
+	// whether voices in steady state are played back from a wavetable (see SteadyStateCache)
+	std::atomic<bool> isWavetableCacheEnabled(true);
 
 	class Sinusoidal {
 		// y(t) = mag(t)*sin(phase(t)), all t in frame offset from block start
@@ -50,14 +79,22 @@ namespace kernel {
 		// phase function coefficients:
 		// phase(t) = phase_c0 + phase_c1*t + phase_c2*t^2
 		float phase_c0, phase_c1, phase_c2;
+	public:
+		Sinusoidal() : mag_c0(0), mag_c1(0), phase_c0(0), phase_c1(0), phase_c2(0) {}
 		__device__ __host__ float phaseAtIdx(unsigned idx) const {
 			return phase_c0 + idx*(phase_c1 + idx*phase_c2);
 		}
 		__device__ __host__ float magAtIdx(unsigned idx) const {
 			return mag_c0 + idx*mag_c1;
 		}
-	public:
-		Sinusoidal() : mag_c0(0), mag_c1(0), phase_c0(0), phase_c1(0), phase_c2(0) {}
+		// restart the sinusoid at phase (at idx 0) without changing its frequency
+		__host__ void setPhase(float phase) {
+			phase_c0 = phase;
+		}
+		// the largest |value| may get within the block (the magnitude is linear, so it peaks at one of the ends)
+		__host__ float maxMagnitude() const {
+			return max(fabsf(magAtIdx(0)), fabsf(magAtIdx(BUFFER_BLOCK_SIZE)));
+		}
 		// startFreq, endFreq given in rad/sec
 		__device__ __host__ void newFrequencyAndDepth(float startFreq, float endFreq, float startDepth, float endDepth) {
 			// compute phase function coefficients
@@ -83,20 +120,27 @@ namespace kernel {
 			// freq = d/dt (phase)
 			return phase_c1 + 2 * phase_c2*idx;
 		}
+		__host__ void toLanes(simd::SinusoidLanes *lanes, unsigned lane) const {
+			lanes->mag_c0[lane] = mag_c0;
+			lanes->mag_c1[lane] = mag_c1;
+			lanes->phase_c0[lane] = phase_c0;
+			lanes->phase_c1[lane] = phase_c1;
+			lanes->phase_c2[lane] = phase_c2;
+		}
 	};
 
 	class RandomNumberGen {
-		float randomValues[DETUNE_NUM_SEEDS][NUM_PARTIALS];
+		float randomValues[DETUNE_NUM_SEEDS][MAX_PARTIALS];
 	public:
 		RandomNumberGen() {
-			// want randomValues[i][j] to stay the same regardless of NUM_PARTIALS,
+			// want randomValues[i][j] to stay the same regardless of MAX_PARTIALS,
 			// so process each row with an independent seed.
 			// create the seeds with ANOTHER random number generator
 			std::minstd_rand seedGen(119606366); // seed chosen from random.org.
 			std::minstd_rand rng;
 			for (int row = 0; row < DETUNE_NUM_SEEDS; ++row) {
 				rng.seed(seedGen());
-				for (int partial = 0; partial < NUM_PARTIALS; ++partial) {
+				for (int partial = 0; partial < MAX_PARTIALS; ++partial) {
 					// generate a normalized random number [0, 1)
 					float normRand = (float)rng() / 2147483648.f;
 					// turn this into a symmetric distribution from (-1, 1) centered at 0.
@@ -107,7 +151,7 @@ namespace kernel {
 		}
 		// return a random number from interpolated the N seeds evaluated at partialIdx.
 		// seedNo should be between [0, 1]
-		__host__ __device__ float getFor(float seedNo, unsigned partialIdx) {
+		__host__ __device__ float getFor(float seedNo, unsigned partialIdx) const {
 			// Interpolate the seeds using the following algorithm:
 			// v(seed, partial) = (1 - seed^2)*seed0[partial] + (1 - (seed-1/N))*seed1[partial] + (1 - (seed-2/N))*seed2[partial] + ...
 			// where N is the number of seeds MINUS 1.
@@ -121,6 +165,278 @@ namespace kernel {
 		}
 	};
 
+	// The parameters, compiled into what the block setup of each partial needs (see ParameterSnapshot),
+	//   so that it doesn't work out the same segment lengths, levels and slopes from them on every block.
+	// Compiling does the same arithmetic as the code it replaces, in the same order, so the results are exactly the same.
+
+	// an ADSR's segments as seen by one partial
+	struct CompiledADSR {
+		// the start level of each segment, its length in samples and the inverse of that.
+		// A block looks at the segment it starts in and the two after it, so PastEndMode is repeated twice more at the end.
+		float levels[ADSR::PastEndMode + 3];
+		float lengths[ADSR::PastEndMode + 3];
+		float invLengths[ADSR::PastEndMode + 3];
+		__host__ void compile(const ADSR *adsr, float partialPos) {
+			for (unsigned mode = 0; mode <= ADSR::PastEndMode + 2; ++mode) {
+				ADSR::Mode segment = (ADSR::Mode)std::min(mode, (unsigned)ADSR::PastEndMode);
+				levels[mode] = adsr->getSegmentStartLevel(segment, partialPos);
+				lengths[mode] = adsr->getSegmentLength(segment, partialPos) * SAMPLE_RATE;
+				invLengths[mode] = 1.f / lengths[mode];
+			}
+		}
+	};
+
+	struct CompiledLFO {
+		CompiledADSR freq;
+		CompiledADSR depth;
+		__host__ void compile(const LFO *lfo, float partialPos) {
+			freq.compile(lfo->getFreqAdsr(), partialPos);
+			depth.compile(lfo->getDepthAdsr(), partialPos);
+		}
+	};
+
+	struct CompiledADSRLFOEnvelope {
+		CompiledADSR adsr;
+		CompiledLFO lfo;
+		__host__ void compile(ADSRLFOEnvelope *env, float partialPos) {
+			adsr.compile(env->getAdsr(), partialPos);
+			lfo.compile(env->getLfo(), partialPos);
+		}
+	};
+
+	struct CompiledDelayEnvelope {
+		CompiledADSRLFOEnvelope spaceBetweenEchoes;
+		CompiledADSRLFOEnvelope amplitudeLostPerEcho;
+		__host__ void compile(DelayEnvelope *env, float partialPos) {
+			spaceBetweenEchoes.compile(env->getSpaceBetweenEchoes(), partialPos);
+			amplitudeLostPerEcho.compile(env->getAmplitudeLostPerEcho(), partialPos);
+		}
+	};
+
+	// the filter is the same for every partial
+	struct CompiledFilterEnvelope {
+		CompiledADSR shift;
+		unsigned numPoints;
+		// the slope of the shape from each point to the next (0 from the last one on)
+		float slopes[PIECEWISE_MAX_PIECES];
+		__host__ void compile(FilterEnvelope *env) {
+			shift.compile(env->getShift(), 0);
+			const PiecewiseFunction *func = env->getShape();
+			numPoints = func->numPoints();
+			for (unsigned i = 0; i < numPoints; ++i) {
+				slopes[i] = (i + 1 == numPoints) ? 0.f
+					: (func->startLevelOfPiece(i + 1) - func->startLevelOfPiece(i)) / (func->startTimeOfPiece(i + 1) - func->startTimeOfPiece(i));
+			}
+		}
+	};
+
+	// everything in the parameters that depends on the partial
+	struct CompiledPartialParameters {
+		CompiledADSRLFOEnvelope volumeEnvelope;
+		CompiledADSRLFOEnvelope stereoPanEnvelope;
+		CompiledADSRLFOEnvelope detuneEnvelope;
+		CompiledDelayEnvelope delayEnvelope;
+		__host__ void compile(ParameterStates *params, unsigned partialIdx) {
+			float partialPos = (float)partialIdx / params->numPartials;
+			volumeEnvelope.compile(&params->volumeEnvelope, partialPos);
+			stereoPanEnvelope.compile(&params->stereoPanEnvelope, partialPos);
+			detuneEnvelope.compile(params->detuneEnvelope.getAdsrLfo(), partialPos);
+			delayEnvelope.compile(&params->delayEnvelope, partialPos);
+		}
+	};
+
+	// Envelopes that can run the same for every partial of a voice, as bits of a mask.
+	// One whose parameters don't depend on the partial index (ADSR::dependsOnPartialIdx) stays identical for all the partials
+	//   that started it from the same state, so it only has to be worked out for one of them (see sharedEnvelopesOfVoice).
+	enum SharedEnvelope {
+		SharedVolumeEnvelope = 1 << 0,
+		SharedStereoPanEnvelope = 1 << 1,
+		SharedDetuneEnvelope = 1 << 2,
+		SharedDelayEnvelope = 1 << 3,
+		// always shared in the parameters (see CompiledFilterEnvelope)
+		SharedFilterShift = 1 << 4,
+		AllSharedEnvelopes = (1 << 5) - 1
+	};
+
+	struct CompiledParameters {
+		// how much of the random detune each partial gets (see DetuneEnvelopeState).
+		// Given for every partial index, since the block that an edit adds partials in takes it from the parameters before the edit.
+		float detuneWeights[MAX_PARTIALS];
+		CompiledFilterEnvelope filterEnvelope;
+		// one for each of the parameters' numPartials partials (allocated separately)
+		CompiledPartialParameters *partials;
+		// the envelopes that come out the same for every partial (SharedEnvelope bits)
+		unsigned sharedEnvelopes;
+		__host__ void compile(ParameterStates *params, const RandomNumberGen *randomNumbers, CompiledPartialParameters *partialsArray) {
+			float randDepth = params->detuneEnvelope.getRandMix();
+			for (unsigned partialIdx = 0; partialIdx < MAX_PARTIALS; ++partialIdx) {
+				float randOffset = randomNumbers->getFor(params->detuneEnvelope.getRandSeed(), partialIdx);
+				detuneWeights[partialIdx] = 1 + (randOffset - 1)*randDepth;
+			}
+			filterEnvelope.compile(&params->filterEnvelope);
+			for (unsigned partialIdx = 0; partialIdx < params->numPartials; ++partialIdx) {
+				partialsArray[partialIdx].compile(params, partialIdx);
+			}
+			partials = partialsArray;
+			sharedEnvelopes = AllSharedEnvelopes;
+			if (params->volumeEnvelope.dependsOnPartialIdx()) {
+				sharedEnvelopes &= ~SharedVolumeEnvelope;
+			}
+			if (params->stereoPanEnvelope.dependsOnPartialIdx()) {
+				sharedEnvelopes &= ~SharedStereoPanEnvelope;
+			}
+			if (params->detuneEnvelope.getAdsrLfo()->dependsOnPartialIdx()) {
+				sharedEnvelopes &= ~SharedDetuneEnvelope;
+			}
+			if (params->delayEnvelope.dependsOnPartialIdx()) {
+				sharedEnvelopes &= ~SharedDelayEnvelope;
+			}
+		}
+	};
+
+	// How far the echoes of the parameters can reach, which sizes the voices' sample buffers (see requiredSampleBufferLen).
+
+	// the lowest and highest level adsr reaches, for any partial at any time
+	static void levelRange(const ADSR *adsr, float *lowest, float *highest) {
+		// the envelope is piecewise linear, so its extremes are among the segments' start levels
+		float lowestLevel = adsr->getStartLevel(), highestLevel = adsr->getStartLevel();
+		for (unsigned mode = 1; mode <= ADSR::PastEndMode; ++mode) {
+			lowestLevel = std::min(lowestLevel, adsr->getSegmentStartLevel((ADSR::Mode)mode));
+			highestLevel = std::max(highestLevel, adsr->getSegmentStartLevel((ADSR::Mode)mode));
+		}
+		// partials scale every level by between getAmplificationFor(0) and getAmplificationFor(1)
+		float ampA = adsr->getAmplificationFor(0.f), ampB = adsr->getAmplificationFor(1.f);
+		*lowest = std::min(std::min(lowestLevel*ampA, lowestLevel*ampB), std::min(highestLevel*ampA, highestLevel*ampB));
+		*highest = std::max(std::max(lowestLevel*ampA, lowestLevel*ampB), std::max(highestLevel*ampA, highestLevel*ampB));
+	}
+
+	// the furthest the lfo of env swings from 0, for any partial at any time.
+	// LFOState only reads the depth at block boundaries, and from 0 at the start of a note, so the start and peak levels
+	//   only count if the attack and decay last past the first block. The default depth, for instance, peaks at 1
+	//   for a few samples before it sustains at 0, so it never moves the lfo.
+	static float maxLfoDepth(const ADSRLFOEnvelope *env) {
+		const ADSR *depth = env->getLfo()->getDepthAdsr();
+		// once the first block is over, the depth sustains, or heads in a straight line from where it was to its release level
+		float depthLowest = std::min(0.f, std::min(depth->getSustain(), depth->getReleaseLevel()));
+		float depthHighest = std::max(0.f, std::max(depth->getSustain(), depth->getReleaseLevel()));
+		float longestTimeScale = std::max(depth->getTimeScaleFor(0.f), depth->getTimeScaleFor(1.f));
+		if ((depth->getAttack() + depth->getDecay())*longestTimeScale*SAMPLE_RATE >= BUFFER_BLOCK_SIZE) {
+			depthLowest = std::min(depthLowest, std::min(depth->getStartLevel(), depth->getPeakLevel()));
+			depthHighest = std::max(depthHighest, std::max(depth->getStartLevel(), depth->getPeakLevel()));
+		}
+		// partials scale every level by between getAmplificationFor(0) and getAmplificationFor(1)
+		float amp = std::max(fabsf(depth->getAmplificationFor(0.f)), fabsf(depth->getAmplificationFor(1.f)));
+		return std::max(fabsf(depthLowest), fabsf(depthHighest))*amp;
+	}
+
+	// the lowest and highest value of env's adsr * (1 + lfo), for any partial at any time
+	static void productRange(const ADSRLFOEnvelope *env, float *lowest, float *highest) {
+		float adsrLowest, adsrHighest;
+		levelRange(env->getAdsr(), &adsrLowest, &adsrHighest);
+		float depth = maxLfoDepth(env);
+		*lowest = std::min(std::min(adsrLowest*(1 - depth), adsrLowest*(1 + depth)), std::min(adsrHighest*(1 - depth), adsrHighest*(1 + depth)));
+		*highest = std::max(std::max(adsrLowest*(1 - depth), adsrLowest*(1 + depth)), std::max(adsrHighest*(1 - depth), adsrHighest*(1 + depth)));
+	}
+
+	// the level of adsr t seconds into a held note, if its attack starts from startLevel
+	static float heldLevelAt(const ADSR *adsr, float startLevel, float t) {
+		float attack = adsr->getAttack(), decay = adsr->getDecay();
+		if (t < attack) {
+			return startLevel + (adsr->getPeakLevel() - startLevel)*t / attack;
+		} else if (t < attack + decay) {
+			return adsr->getPeakLevel() + (adsr->getSustain() - adsr->getPeakLevel())*(t - attack) / decay;
+		}
+		return adsr->getSustain();
+	}
+
+	// Echo e of a sample lands e*(1 + space*SAMPLE_RATE) samples after it, and is heard while e*loss < 1.
+	// Returns the furthest any echo lands for a (loss, space) pair within the convex hull of the numPoints points
+	//   (each a loss and a space), once lfos of lossDepth and spaceDepth scale each by anything within (1 +- depth).
+	static float farthestEchoWithin(const float(*points)[2], unsigned numPoints, float lossDepth, float spaceDepth) {
+		float reach = 0.f;
+		for (unsigned e = 1; e <= MAX_DELAY_ECHOES; ++e) {
+			// wherever the loss is below maxLoss, an lfo can bring it below 1/e
+			bool isAlwaysHeard = lossDepth >= 1.f;
+			float maxLoss = isAlwaysHeard ? 0.f : 1.f / (e*(1.f - lossDepth));
+			// the longest space is at a corner of the part of the hull where the echo is heard: one of the points,
+			//   or where a line between two of them crosses maxLoss (which lies within the hull, if not on its edge)
+			float longestSpace = 0.f;
+			for (unsigned i = 0; i < numPoints; ++i) {
+				bool isHeard = isAlwaysHeard || points[i][0] < maxLoss;
+				if (isHeard) {
+					longestSpace = std::max(longestSpace, points[i][1]*(points[i][1] > 0.f ? 1.f + spaceDepth : 1.f - spaceDepth));
+				}
+				for (unsigned j = i + 1; j < numPoints && !isAlwaysHeard; ++j) {
+					if (isHeard != (points[j][0] < maxLoss)) {
+						float position = (maxLoss - points[i][0]) / (points[j][0] - points[i][0]);
+						float space = points[i][1] + (points[j][1] - points[i][1])*position;
+						longestSpace = std::max(longestSpace, space*(space > 0.f ? 1.f + spaceDepth : 1.f - spaceDepth));
+					}
+				}
+			}
+			reach = std::max(reach, e*(1.f + longestSpace*SAMPLE_RATE));
+		}
+		return reach;
+	}
+
+	// When every partial shares the envelopes, the loss and space move in step: the least loss can only pair with
+	//   whatever space the same moment has. With the default envelopes, for instance, the loss is only low while
+	//   both envelopes are ramping up from 0 or back down to it, and the space is short then too.
+	static float farthestEchoOfSharedEnvelopes(const DelayEnvelope *delay) {
+		const ADSR *loss = delay->getAmplitudeLostPerEcho()->getAdsr();
+		const ADSR *space = delay->getSpaceBetweenEchoes()->getAdsr();
+		float lossDepth = maxLfoDepth(delay->getAmplitudeLostPerEcho());
+		float spaceDepth = maxLfoDepth(delay->getSpaceBetweenEchoes());
+		// while the note is held, both envelopes move in a straight line between the times either changes segment
+		float times[5] = { 0.f, loss->getAttack(), loss->getAttack() + loss->getDecay(),
+			space->getAttack(), space->getAttack() + space->getDecay() };
+		std::sort(times, times + 5);
+		// once the note is released, both head in a straight line to their release level, each over its own release time
+		float quickerRelease = std::min(loss->getRelease(), space->getRelease());
+		float lossProgress = quickerRelease / loss->getRelease(), spaceProgress = quickerRelease / space->getRelease();
+		float reach = 0.f;
+		// a note's first block ramps up from 0 rather than from the start level (see ADSRState), so allow for both
+		for (int isFromZero = 0; isFromZero < 2; ++isFromZero) {
+			float lossStart = isFromZero ? 0.f : loss->getStartLevel();
+			float spaceStart = isFromZero ? 0.f : space->getStartLevel();
+			for (unsigned i = 0; i + 1 < 5; ++i) {
+				// the pairs while the note is held from times[i] to times[i + 1], and when it is released in between:
+				//   up to when either envelope reaches its release level, and from then on
+				float corners[4][2];
+				for (unsigned k = 0; k < 2; ++k) {
+					float heldLoss = heldLevelAt(loss, lossStart, times[i + k]);
+					float heldSpace = heldLevelAt(space, spaceStart, times[i + k]);
+					corners[k][0] = heldLoss;
+					corners[k][1] = heldSpace;
+					corners[2 + k][0] = heldLoss + (loss->getReleaseLevel() - heldLoss)*lossProgress;
+					corners[2 + k][1] = heldSpace + (space->getReleaseLevel() - heldSpace)*spaceProgress;
+				}
+				float releasedCorners[3][2] = { { corners[2][0], corners[2][1] }, { corners[3][0], corners[3][1] },
+					{ loss->getReleaseLevel(), space->getReleaseLevel() } };
+				reach = std::max(reach, farthestEchoWithin(corners, 4, lossDepth, spaceDepth));
+				reach = std::max(reach, farthestEchoWithin(releasedCorners, 3, lossDepth, spaceDepth));
+			}
+		}
+		return reach;
+	}
+
+	// how many samples past the sample that produced it an audible echo of delay may land, for any partial at any time
+	//   (at most MAX_DELAY_EFFECT_LENGTH, past which echoes wrap around the delay buffer).
+	static unsigned maxEchoReach(const DelayEnvelope *delay) {
+		float reach;
+		if (delay->dependsOnPartialIdx()) {
+			// every partial runs through its envelopes at its own pace, so pair the least loss with the longest space
+			float leastLoss, mostLoss, shortestSpace, longestSpace;
+			productRange(delay->getAmplitudeLostPerEcho(), &leastLoss, &mostLoss);
+			productRange(delay->getSpaceBetweenEchoes(), &shortestSpace, &longestSpace);
+			float pair[1][2] = { { leastLoss, longestSpace } };
+			reach = farthestEchoWithin(pair, 1, 0.f, 0.f);
+		} else {
+			reach = farthestEchoOfSharedEnvelopes(delay);
+		}
+		return reach < MAX_DELAY_EFFECT_LENGTH ? (unsigned)reach : MAX_DELAY_EFFECT_LENGTH;
+	}
+
 	class ADSRState {
 		// better approach (not yet implemented):
 		//   upon ADSR change:
@@ -174,7 +490,7 @@ namespace kernel {
 			line0_c0(0), line0_c1(0), 
 			line1_c0(0), line1_c1(0),
 			line0_invLength(1e-7f), line1_invLength(1e-7f) {}
-		__device__ __host__ void atBlockStart(ADSR *start, ADSR *end, unsigned partialIdx, bool released, bool didParamsChange) {
+		__device__ __host__ void atBlockStart(const CompiledADSR *end, bool released) {
 			// preserve previous value
 			float prevValue = valueAtIdx(BUFFER_BLOCK_SIZE);
 			// track position in envelope
@@ -185,22 +501,22 @@ namespace kernel {
 			// if we're released, skip to release mode (or further)
 			P = max(P, released*(float)(unsigned)ADSR::ReleaseMode);
 			// update slope of segment and rate at which we progress:
-			float line0_length = end->getSegmentLength(getMode(), partialIdx) * SAMPLE_RATE;
-			line0_invLength = 1.f / line0_length;
-			float line1_length = end->getSegmentLength(nextMode(getMode()), partialIdx) * SAMPLE_RATE;
-			line1_invLength = 1.f / line1_length;
+			unsigned mode = (unsigned)getMode();
+			line0_invLength = end->invLengths[mode];
+			float line1_length = end->lengths[mode + 1];
+			line1_invLength = end->invLengths[mode + 1];
 			// calculate endpoint values for our lines
 			float line0_endPointX, line0_endPointY;
 			// float line0_relPositionAtBufferBlockSize = pFromIdx(BUFFER_BLOCK_SIZE) - (float)(unsigned)getMode();
 			// float line0_valueAtBufferBlockSize = interpolate(line0_relPositionAtBufferBlockSize, end->getSegmentStartLevel(getMode()), end->getSegmentStartLevel(nextMode(getMode())));
 			if ((unsigned)P == (unsigned)ADSR::SustainMode || (unsigned)P == (unsigned)ADSR::EndMode) {
 				line0_endPointX = unclampedPFromIdx(BUFFER_BLOCK_SIZE);
-				line0_endPointY = interpolate(line0_endPointX - (float)(unsigned)getMode(), end->getSegmentStartLevel(getMode(), partialIdx), end->getSegmentStartLevel(nextMode(getMode()), partialIdx));
+				line0_endPointY = interpolate(line0_endPointX - (float)mode, end->levels[mode], end->levels[mode + 1]);
 			} else {
-				line0_endPointX = (float)(unsigned)nextMode(getMode());
-				line0_endPointY = end->getSegmentStartLevel(nextMode(getMode()), partialIdx);
+				line0_endPointX = (float)(mode + 1);
+				line0_endPointY = end->levels[mode + 1];
 			}
-			float line1_startValue = end->getSegmentStartLevel(nextMode(getMode()), partialIdx);
+			float line1_startValue = end->levels[mode + 1];
 			// update c0 and c1 based on the following constraints:
 			// value(P) == prevValue
 			// value(endPointX) == endPointY
@@ -213,8 +529,8 @@ namespace kernel {
 			// then calculate the coefficients for the second portion of the line
 			// line1(endP) == startVal
 			// line1(endP+length1*sample_rate*IL0) == endVal
-			unsigned endP = (unsigned)nextMode(getMode());
-			float line1_endValue = end->getSegmentStartLevel(nextMode(nextMode(getMode())), partialIdx);
+			unsigned endP = mode + 1;
+			float line1_endValue = end->levels[mode + 2];
 			// c0 + c1*endP == startVal
 			// c0 + c1*endP + c1*length1*IL0 == endVal
 			// c1*length1*IL0 == endVal - startVal
@@ -233,12 +549,45 @@ namespace kernel {
 		__device__ __host__ bool isActiveAtEndOfBlock() const {
 			return pFromIdx(BUFFER_BLOCK_SIZE) < (unsigned)ADSR::EndMode;
 		}
+		// whether the envelope moves on to its second line or comes to rest at clampP within the block,
+		//   which an approximation from a few points of the block would cut across
+		__host__ bool turnsCornerOverBlock() const {
+			float startP = unclampedPFromIdx(0.f);
+			float endP = unclampedPFromIdx((float)BUFFER_BLOCK_SIZE);
+			float switchP = (float)(unsigned)nextMode(getMode());
+			return (startP < switchP && switchP < endP) || (startP < clampP && clampP < endP);
+		}
 		__device__ __host__ float valueAtIdx(unsigned idx) const {
 			// return either the first or second line evaluated at idx, depending on where the switch occurs
 			float pIdx = pFromIdx((float)idx);
 			bool seg = segmentFromP(pIdx);
 			return (!seg)*(line0_c0 + pIdx*line0_c1) + (seg)*(line1_c0 + pIdx*line1_c1);
 		}
+		// the range of values taken within the block. Both lines are straight, so the extremes lie at the ends of the block
+		//   or on either side of the switch between them.
+		__device__ __host__ void rangeOverBlock(float *lowest, float *highest) const {
+			float startValue = valueAtIdx(0);
+			float endValue = valueAtIdx(BUFFER_BLOCK_SIZE);
+			*lowest = min(startValue, endValue);
+			*highest = max(startValue, endValue);
+			float switchP = (float)(unsigned)nextMode(getMode());
+			if (pFromIdx(0.f) < switchP && switchP <= pFromIdx((float)BUFFER_BLOCK_SIZE)) {
+				float line0End = line0_c0 + switchP*line0_c1;
+				float line1Start = line1_c0 + switchP*line1_c1;
+				*lowest = min(*lowest, min(line0End, line1Start));
+				*highest = max(*highest, max(line0End, line1Start));
+			}
+		}
+		__host__ void toLanes(simd::ADSRLanes *lanes, unsigned lane) const {
+			lanes->P[lane] = P;
+			lanes->clampP[lane] = clampP;
+			lanes->switchP[lane] = (float)(unsigned)nextMode(getMode());
+			lanes->line0_invLength[lane] = line0_invLength;
+			lanes->line0_c0[lane] = line0_c0;
+			lanes->line0_c1[lane] = line0_c1;
+			lanes->line1_c0[lane] = line1_c0;
+			lanes->line1_c1[lane] = line1_c1;
+		}
 	};
 
 	class LFOState {
@@ -246,14 +595,10 @@ namespace kernel {
 		ADSRState depthAdsrState;
 		Sinusoidal sinusoid;
 	public:
-		__device__ __host__ void atBlockStart(LFO *start, LFO *end, unsigned partialIdx, bool released, bool didParamsChange) {
-			ADSR *freqAdsrStart =  start->getFreqAdsr();
-			ADSR *depthAdsrStart = start->getDepthAdsr();
-			ADSR *freqAdsrEnd =    end->getFreqAdsr();
-			ADSR *depthAdsrEnd =   end->getDepthAdsr();
+		__device__ __host__ void atBlockStart(const CompiledLFO *end, bool released) {
 			// update the ADSR states
-			freqAdsrState.atBlockStart(freqAdsrStart, freqAdsrEnd, partialIdx, released, didParamsChange);
-			depthAdsrState.atBlockStart(depthAdsrStart, depthAdsrEnd, partialIdx, released, didParamsChange);
+			freqAdsrState.atBlockStart(&end->freq, released);
+			depthAdsrState.atBlockStart(&end->depth, released);
 			// obtain the starting and ending frequency and depth.
 			// We will then just linearly interpolate over the block.
 			float startFreq = freqAdsrState.valueAtIdx(0);
@@ -265,15 +610,21 @@ namespace kernel {
 		__device__ __host__ float valueAtIdx(unsigned idx) const{
 			return sinusoid.valueAtIdx(idx);
 		}
+		__host__ float maxDepth() const {
+			return sinusoid.maxMagnitude();
+		}
+		__host__ void toLanes(simd::SinusoidLanes *lanes, unsigned lane) const {
+			sinusoid.toLanes(lanes, lane);
+		}
 	};
 
 	class ADSRLFOEnvelopeState {
 		ADSRState adsr;
 		LFOState lfo;
 	public:
-		__device__ __host__ void atBlockStart(ADSRLFOEnvelope *envStart, ADSRLFOEnvelope *envEnd, unsigned partialIdx, bool released, bool didParamsChange) {
-			adsr.atBlockStart(envStart->getAdsr(), envEnd->getAdsr(), partialIdx, released, didParamsChange);
-			lfo.atBlockStart(envStart->getLfo(), envEnd->getLfo(), partialIdx, released, didParamsChange);
+		__device__ __host__ void atBlockStart(const CompiledADSRLFOEnvelope *envEnd, bool released) {
+			adsr.atBlockStart(&envEnd->adsr, released);
+			lfo.atBlockStart(&envEnd->lfo, released);
 		}
 		__device__ __host__ float adsrAtIdx(unsigned idx) const {
 			return adsr.valueAtIdx(idx);
@@ -290,13 +641,54 @@ namespace kernel {
 		__device__ __host__ bool isActiveAtEndOfBlock() const {
 			return adsr.isActiveAtEndOfBlock();
 		}
+		// see ADSRState::turnsCornerOverBlock
+		__host__ bool turnsCornerOverBlock() const {
+			return adsr.turnsCornerOverBlock();
+		}
+		// whether the LFO moves the envelope at all during the block
+		__host__ bool hasLfoDepthOverBlock() const {
+			return lfo.maxDepth() != 0.f;
+		}
+		// whether productAtIdx and sumAtIdx hold still throughout the block
+		__host__ bool isConstantOverBlock() const {
+			float adsrLowest, adsrHighest;
+			adsr.rangeOverBlock(&adsrLowest, &adsrHighest);
+			return adsrLowest == adsrHighest && lfo.maxDepth() == 0.f;
+		}
+		// values that productAtIdx doesn't go below or above within the block
+		__host__ void productRangeOverBlock(float *lowest, float *highest) const {
+			float adsrLowest, adsrHighest;
+			adsr.rangeOverBlock(&adsrLowest, &adsrHighest);
+			float depth = lfo.maxDepth();
+			// the product is linear in each factor, so its extremes are at the corners
+			*lowest = min(min(adsrLowest*(1 - depth), adsrLowest*(1 + depth)), min(adsrHighest*(1 - depth), adsrHighest*(1 + depth)));
+			*highest = max(max(adsrLowest*(1 - depth), adsrLowest*(1 + depth)), max(adsrHighest*(1 - depth), adsrHighest*(1 + depth)));
+		}
+		__host__ float productLowerBound() const {
+			float lowest, highest;
+			productRangeOverBlock(&lowest, &highest);
+			return lowest;
+		}
+		__host__ void toLanes(simd::ADSRLFOLanes *lanes, unsigned lane) const {
+			adsr.toLanes(&lanes->adsr, lane);
+			lfo.toLanes(&lanes->lfo, lane);
+		}
 	};
 
 	class DetuneEnvelopeState {
 		ADSRLFOEnvelopeState adsrLfoState;
 		float weight;
 	public:
-		__device__ __host__ void atBlockStart(SynthState *synthState, DetuneEnvelope *envStart, DetuneEnvelope *envEnd, unsigned partialIdx, bool released, bool didParamsChange);
+		// weight is the partial's share of the random detune, taken from the parameters at the start of the block
+		__device__ __host__ void atBlockStart(float weight, const CompiledADSRLFOEnvelope *envEnd, bool released) {
+			this->weight = weight;
+			adsrLfoState.atBlockStart(envEnd, released);
+		}
+		// start the block from the state of another partial that has already started it from the same parameters
+		__device__ __host__ void atBlockStartFrom(float weight, const DetuneEnvelopeState *shared) {
+			this->weight = weight;
+			adsrLfoState = shared->adsrLfoState;
+		}
 		__device__ __host__ float valueAtIdx(unsigned idx) const {
 			return weight*adsrLfoState.sumAtIdx(idx);
 		}
@@ -306,9 +698,9 @@ namespace kernel {
 		ADSRLFOEnvelopeState spaceBetweenEchoes;
 		ADSRLFOEnvelopeState amplitudeLostPerEcho;
 	public:
-		__device__ __host__ void atBlockStart(DelayEnvelope *envStart, DelayEnvelope *envEnd, unsigned partialIdx, bool released, bool didParamsChange) {
-			spaceBetweenEchoes.atBlockStart(envStart->getSpaceBetweenEchoes(), envEnd->getSpaceBetweenEchoes(), partialIdx, released, didParamsChange);
-			amplitudeLostPerEcho.atBlockStart(envStart->getAmplitudeLostPerEcho(), envEnd->getAmplitudeLostPerEcho(), partialIdx, released, didParamsChange);
+		__device__ __host__ void atBlockStart(const CompiledDelayEnvelope *envEnd, bool released) {
+			spaceBetweenEchoes.atBlockStart(&envEnd->spaceBetweenEchoes, released);
+			amplitudeLostPerEcho.atBlockStart(&envEnd->amplitudeLostPerEcho, released);
 		}
 		__device__ __host__ float spaceBetweenEchoesAtIdx(unsigned idx) const {
 			//return spaceBetweenEchoes.adsrAtIdx(idx);
@@ -318,6 +710,25 @@ namespace kernel {
 			//return amplitudeLostPerEcho.adsrAtIdx(idx);
 			return amplitudeLostPerEcho.productAtIdx(idx);
 		}
+		// whether every echo has zero amplitude throughout the block (the first echo is the loudest)
+		__host__ bool areEchoesSilent() const {
+			return amplitudeLostPerEcho.productLowerBound() >= 1.f;
+		}
+		// how many samples past the one that produced it an echo from this block may land (0 if every echo is silent)
+		__host__ unsigned maxEchoReach() const {
+			if (areEchoesSilent()) {
+				return 0;
+			}
+			float shortestSpace, longestSpace;
+			spaceBetweenEchoes.productRangeOverBlock(&shortestSpace, &longestSpace);
+			// past the buffer's length, echoes wrap around anyway
+			float reach = MAX_DELAY_ECHOES * (1.f + max(longestSpace, 0.f)*SAMPLE_RATE);
+			return reach < CIRCULAR_BUFFER_LEN ? (unsigned)reach : CIRCULAR_BUFFER_LEN;
+		}
+		__host__ void toLanes(simd::DelayLanes *lanes, unsigned lane) const {
+			spaceBetweenEchoes.toLanes(&lanes->spaceBetweenEchoes, lane);
+			amplitudeLostPerEcho.toLanes(&lanes->amplitudeLostPerEcho, lane);
+		}
 	};
 
 	class FilterState {
@@ -338,130 +749,385 @@ namespace kernel {
 		// determining the coefficients becomes slightly more difficult. 
 		// an can be solved by knowing the slope along each interval.
 		// b can be solved by substituting y(0) = sum[an*Ln] + b
+		//
+		// Within one block, w only sweeps a narrow range, so most breakpoints are never crossed:
+		//   those below the range only contribute to the slope of the line it starts on, and those above contribute nothing.
+		// So at the start of each block, the segment holding the lowest w is found by binary search, and the sum is
+		//   rebuilt as that segment's line plus the breakpoints within the range:
+		// y(w) = c0 + c1*w + sum[an*max(w, Ln)], for the Ln crossed in this block only.
 		struct Piece {
 			float beginTime;
 			float slope;
 		};
-		Piece pieces[PIECEWISE_MAX_PIECES];
-		float b;
+		Piece breakpoints[FILTER_MAX_BREAKPOINTS_PER_BLOCK];
+		unsigned numBreakpoints;
+		float c0, c1;
 		float freq_c0, freq_c1;
+		// whether the function is zero over the whole range of w of the block
+		bool isSilent;
+		// add an*max(w, Ln) to the sum, moving an*Ln into c0 so that it only changes the function beyond Ln
+		__device__ __host__ void addBreakpoint(float beginTime, float slopeChange) {
+			breakpoints[numBreakpoints].beginTime = beginTime;
+			breakpoints[numBreakpoints].slope = slopeChange;
+			c0 -= slopeChange*beginTime;
+			++numBreakpoints;
+		}
 	public:
-		__device__ __host__ void atBlockStart(FilterEnvelope *envStart, FilterEnvelope *envEnd, float freqStart, float freqEnd, bool released, bool didParamsChange) {
-			shiftState.atBlockStart(envStart->getShift(), envEnd->getShift(), 0, released, didParamsChange);
+		// sharedShift, if not NULL, is the filter of another partial whose shift has already started the block from the same parameters
+		__device__ __host__ void atBlockStart(FilterEnvelope *envEnd, const CompiledFilterEnvelope *compiledEnd, float freqStart, float freqEnd, bool released, const FilterState *sharedShift) {
+			if (sharedShift != NULL) {
+				shiftState = sharedShift->shiftState;
+			} else {
+				shiftState.atBlockStart(&compiledEnd->shift, released);
+			}
 			// set the frequency coefficients such that:
 			// w(idx) = freq_c0 + freq_c1*idx
 			// w(0) = freqStart,
 			// w(BUFFER_BLOCK_SIZE) = freqEnd,
 			freq_c0 = freqStart;
 			freq_c1 = (freqEnd - freqStart) * INV_BUFFER_BLOCK_SIZE;
+			// the range of w (the frequency less the shift) over the block
+			float shiftLowest, shiftHighest;
+			shiftState.rangeOverBlock(&shiftLowest, &shiftHighest);
+			float wLowest = min(freqStart, freqEnd) - shiftHighest;
+			float wHighest = max(freqStart, freqEnd) - shiftLowest;
 			// determine the coefficients.
 			// no filter interpolation for now, since that requires doubling the number of nodes
 			PiecewiseFunction *func = envEnd->getShape();
-			unsigned numActivePieces = func->numPoints();
-			float y0 = func->startLevelOfPiece(0);
-			float offsetSum = 0;
-			float prevSlope = 0.f;
-			for (unsigned i = 0; i < numActivePieces; ++i) {
-				float thisBeginTime = func->startTimeOfPiece(i);
-				float nextTime = func->startTimeOfPiece(i + 1);
-				float thisLength = nextTime - thisBeginTime;
-				float overallSlope = (i + 1 == numActivePieces) ? 0.f
-					: (func->startLevelOfPiece(i + 1) - func->startLevelOfPiece(i)) / thisLength;
-				float thisSlope = overallSlope - prevSlope;
-				prevSlope = overallSlope;
-				pieces[i].slope = thisSlope;
-				pieces[i].beginTime = thisBeginTime;
-				offsetSum += thisSlope*thisBeginTime;
-			}
-			// determine the coefficient 'b':
-			// y(0) = sum[slope_n*beginTime_n] + b
-			// b = y(0) - sum[slope_n*beginTime_n]
-			b = y0 - offsetSum;
-			// zero contributions from inactive pieces
-			for (unsigned i = numActivePieces; i < PIECEWISE_MAX_PIECES; ++i) {
-				pieces[i].slope = 0;
-				pieces[i].beginTime = 0;
+			unsigned numPoints = compiledEnd->numPoints;
+			// the breakpoints crossed in this block are those strictly between wLowest and wHighest.
+			// The function is flat before its first point and after its last.
+			unsigned firstCrossed = func->numPointsUpTo(wLowest, numPoints);
+			unsigned endCrossed = func->numPointsUpTo(wHighest, numPoints);
+			while (endCrossed > firstCrossed && func->startTimeOfPiece(endCrossed - 1) >= wHighest) {
+				--endCrossed;
+			}
+			unsigned numCrossed = endCrossed - firstCrossed;
+			// the function is linear between points, so it is zero throughout if it is at both ends and every point in between
+			isSilent = func->valueAt(wLowest, numPoints) == 0.f && func->valueAt(wHighest, numPoints) == 0.f;
+			for (unsigned i = firstCrossed; i < endCrossed && isSilent; ++i) {
+				isSilent = func->startLevelOfPiece(i) == 0.f;
+			}
+			numBreakpoints = 0;
+			if (numCrossed <= FILTER_MAX_BREAKPOINTS_PER_BLOCK) {
+				// exact: start from the line of the segment holding wLowest, then add each crossed breakpoint's change in slope
+				float slope = 0.f;
+				if (firstCrossed == 0) {
+					c0 = func->startLevelOfPiece(0);
+				} else {
+					unsigned segment = firstCrossed - 1;
+					c0 = func->startLevelOfPiece(segment);
+					if (segment + 1 < numPoints) {
+						slope = compiledEnd->slopes[segment];
+						c0 -= slope*func->startTimeOfPiece(segment);
+					}
+				}
+				c1 = slope;
+				for (unsigned i = firstCrossed; i < endCrossed; ++i) {
+					float overallSlope = compiledEnd->slopes[i];
+					addBreakpoint(func->startTimeOfPiece(i), overallSlope - slope);
+					slope = overallSlope;
+				}
+			} else {
+				// too many to evaluate per sample: follow the function through an evenly spread selection of them instead,
+				//   joined by straight lines to its values at either end of the range.
+				// The result stays within the levels of the points it skips.
+				float prevTime = wLowest;
+				float prevLevel = func->valueAt(wLowest, numPoints);
+				float slope = 0.f;
+				for (unsigned k = 0; k <= FILTER_MAX_BREAKPOINTS_PER_BLOCK; ++k) {
+					float time = wHighest;
+					float level = func->valueAt(wHighest, numPoints);
+					if (k < FILTER_MAX_BREAKPOINTS_PER_BLOCK) {
+						unsigned i = firstCrossed + (2 * k + 1)*numCrossed / (2 * FILTER_MAX_BREAKPOINTS_PER_BLOCK);
+						time = func->startTimeOfPiece(i);
+						level = func->startLevelOfPiece(i);
+					}
+					float segmentSlope = (level - prevLevel) / (time - prevTime);
+					if (k == 0) {
+						c1 = segmentSlope;
+						c0 = prevLevel - segmentSlope*prevTime;
+					} else {
+						addBreakpoint(prevTime, segmentSlope - slope);
+					}
+					slope = segmentSlope;
+					prevTime = time;
+					prevLevel = level;
+				}
+			}
+			// zero contributions from unused slots
+			for (unsigned i = numBreakpoints; i < FILTER_MAX_BREAKPOINTS_PER_BLOCK; ++i) {
+				breakpoints[i].slope = 0;
+				breakpoints[i].beginTime = 0;
 			}
 		}
 		__device__ __host__ float valueAtIdx(unsigned idx) const {
-			// y(w) = sum[an*max(w, Ln)] + b
-			float sum = b;
+			// y(w) = c0 + c1*w + sum[an*max(w, Ln)]
 			float w = freq_c0 + idx*freq_c1;
 			// transpose the envelope by shiftin the frequency
 			w -= shiftState.valueAtIdx(idx);
-			for (int i = 0; i < PIECEWISE_MAX_PIECES; ++i) {
-				sum += pieces[i].slope * max(w, pieces[i].beginTime);
+			float sum = c0 + c1*w;
+			for (unsigned i = 0; i < numBreakpoints; ++i) {
+				sum += breakpoints[i].slope * max(w, breakpoints[i].beginTime);
 			}
 			return sum;
 		}
+		// whether valueAtIdx holds still throughout the block
+		__host__ bool isConstantOverBlock() const {
+			float shiftLowest, shiftHighest;
+			shiftState.rangeOverBlock(&shiftLowest, &shiftHighest);
+			return shiftLowest == shiftHighest && freq_c1 == 0.f;
+		}
+		// whether valueAtIdx is c0 whatever the frequency and shift, i.e. the function is flat over the range of w of the block
+		__host__ bool isFlatOverBlock() const {
+			return numBreakpoints == 0 && c1 == 0.f;
+		}
+		// whether the filter mutes the partial throughout the block
+		__device__ __host__ bool isSilentOverBlock() const {
+			return isSilent;
+		}
+		__host__ void toLanes(simd::FilterLanes *lanes, unsigned lane) const {
+			shiftState.toLanes(&lanes->shift, lane);
+			for (int i = 0; i < FILTER_MAX_BREAKPOINTS_PER_BLOCK; ++i) {
+				lanes->breakpointBeginTime[i][lane] = breakpoints[i].beginTime;
+				lanes->breakpointSlope[i][lane] = breakpoints[i].slope;
+			}
+			// the group evaluates as many breakpoints as its busiest lane (the rest have zero slope)
+			lanes->numBreakpoints = (lane == 0) ? numBreakpoints : max(lanes->numBreakpoints, numBreakpoints);
+			lanes->c0[lane] = c0;
+			lanes->c1[lane] = c1;
+			lanes->freq_c0[lane] = freq_c0;
+			lanes->freq_c1[lane] = freq_c1;
+		}
+		__host__ void shiftToLanes(simd::ADSRLanes *lanes, unsigned lane) const {
+			shiftState.toLanes(lanes, lane);
+		}
 	};
 
-	// Contains info about the parameter states at ANY sample in the block
+	// Contains info about the parameter states at ANY sample in the block.
+	// Everything points into parameter snapshots (see ParameterSnapshot) that the voice holds a reference to,
+	//   and start and end are the same whenever the parameters don't change over the block.
 	struct FullBlockParameterInfo {
-		ParameterStates start;
-		ParameterStates end;
+		ParameterStates *start;
+		ParameterStates *end;
+		// the same parameters, compiled
+		CompiledParameters *compiledStart;
+		CompiledParameters *compiledEnd;
 	};
 
-	// Contains extra state information relevant to each individual partial
-	struct PartialState {
-		Sinusoidal sinusoid;
-		ADSRLFOEnvelopeState volumeEnvelope;
-		ADSRLFOEnvelopeState stereoPanEnvelope;
-		DetuneEnvelopeState detuneEnvelope;
-		DelayEnvelopeState delayState;
-		FilterState filterState;
-		PartialState() {}
-		PartialState(struct SynthState *synthState, unsigned voiceNum, unsigned partialIdx) {}
-		__device__ __host__ void atBlockStart(SynthState *synthState, SynthVoiceState *voiceState, unsigned partialIdx, float fundamentalFreq, bool released);
+	// Contains extra state information relevant to each individual partial, for every partial of every voice.
+	// Stored as one contiguous array per component (structure of arrays) rather than one struct per partial,
+	//   so that a component's state for neighbouring partials is adjacent in memory.
+	// Every array is indexed by indexOf(voiceNum, threadIdWithinPartial, partialIdx).
+	struct PartialStates {
+		unsigned numVoices;
+		unsigned threadsPerPartial;
+		// number of partials allocated for; grows as presets ask for more partials.
+		unsigned capacity;
+		Sinusoidal *sinusoids;
+		ADSRLFOEnvelopeState *volumeEnvelopes;
+		ADSRLFOEnvelopeState *stereoPanEnvelopes;
+		DetuneEnvelopeState *detuneEnvelopes;
+		DelayEnvelopeState *delayStates;
+		FilterState *filterStates;
+		PartialStates() : numVoices(0), threadsPerPartial(0), capacity(0),
+			sinusoids(NULL), volumeEnvelopes(NULL), stereoPanEnvelopes(NULL),
+			detuneEnvelopes(NULL), delayStates(NULL), filterStates(NULL) {}
+		__device__ __host__ unsigned indexOf(unsigned voiceNum, unsigned threadIdWithinPartial, unsigned partialIdx) const {
+			return (voiceNum*threadsPerPartial + threadIdWithinPartial)*capacity + partialIdx;
+		}
+		// number of entries per array that belong to each voice (they are contiguous)
+		__device__ __host__ unsigned numPerVoice() const {
+			return threadsPerPartial*capacity;
+		}
+		// every array ends with one spare row of capacity default-constructed entries, which no voice ever renders:
+		//   resetting a partial copies from it rather than constructing defaults on the host.
+		__host__ unsigned defaultsIdx() const {
+			return numVoices*numPerVoice();
+		}
 	};
 
 	struct SynthVoiceState {
 		FullBlockParameterInfo parameterInfo;
-		float sampleBuffer[CIRCULAR_BUFFER_LEN*NUM_CH];
-		// assume the GPU will require more threads than CPU,
-		// so allocate enough space for either CPU or GPU implementation
-		PartialState partialStates[NUM_THREADS_PER_PARTIAL_GPU][NUM_PARTIALS];
-		SynthVoiceState() {
-			memset(sampleBuffer, 0, sizeof(sampleBuffer));
+		// circular buffer of bufferLen samples (interleaved by channel), long enough for the furthest echo
+		//   the parameters can produce. Allocated separately (see growSampleBuffer).
+		float *sampleBuffer;
+		unsigned bufferLen;
+		// whether the current block's echoes are applied to the sum of the partials (see mixEchoesOfSample)
+		//   instead of being scattered by every partial. Decided before the partials render (see setAsideEarlierEchoes).
+		bool areEchoesMixed;
+		// while the partials render, the echoes that earlier blocks left in the current block;
+		//   then the block's output without them, whose echoes are still to be mixed.
+		float echoScratch[BUFFER_BLOCK_SIZE*NUM_CH];
+		// cleared before each block; set by every partial whose volume envelope is still going at the end of it
+		bool arePartialsActive;
+		// the envelopes (SharedEnvelope bits) that every partial takes from partial 0 at the start of the block;
+		//   set from sharedEnvelopesOfVoice on the CPU, always 0 on the GPU.
+		unsigned sharedEnvelopes;
+		SynthVoiceState() : sampleBuffer(NULL), bufferLen(0), areEchoesMixed(false), arePartialsActive(false), sharedEnvelopes(0) {
+			parameterInfo.start = parameterInfo.end = NULL;
+			parameterInfo.compiledStart = parameterInfo.compiledEnd = NULL;
+			memset(echoScratch, 0, sizeof(echoScratch));
+		}
+		// index in sampleBuffer of the first channel of absolute sample absIdx.
+		// bufferLen is a power of two, so this stays continuous as absIdx wraps around.
+		__device__ __host__ unsigned bufferIdxOf(unsigned absIdx) const {
+			return NUM_CH * (absIdx % bufferLen);
 		}
 	};
 
 	// Packages all the state-related information for the synth in one class to store persistently on the device
 	struct SynthState {
-		RandomNumberGen randomNumbers;
-		SynthVoiceState voiceStates[MAX_SIMULTANEOUS_SYNTH_NOTES];
+		// one per voice; allocated separately (see setPolyphony)
+		SynthVoiceState *voiceStates;
+		PartialStates partialStates;
+		SynthState() : voiceStates(NULL) {}
 	};
 
-	__host__ __device__ void DetuneEnvelopeState::atBlockStart(SynthState *synthState, DetuneEnvelope *envStart, DetuneEnvelope *envEnd, unsigned partialIdx, bool released, bool didParamsChange) {
-		float randDepth = envStart->getRandMix();
-		float randOffset = synthState->randomNumbers.getFor(envStart->getRandSeed(), partialIdx);
-		weight = 1 + (randOffset - 1)*randDepth;
-		adsrLfoState.atBlockStart(envStart->getAdsrLfo(), envEnd->getAdsrLfo(), partialIdx, released, didParamsChange);
-	}
+	// host-side copy of d_synthState->partialStates (whose arrays live on the device),
+	//   which can only change while every voice lock is held.
+	PartialStates d_partialStates;
+	// number of partials each voice renders; only changes while that voice's lock is held.
+	unsigned numPartialsOfVoice[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	// The part of each voice's sample buffer that may hold nonzero samples, as absolute sample indices [begin, end):
+	//   from the start of the last block rendered (each block zeroes the one before it) to past the furthest echo written since.
+	// onNoteStart then only has to clear this range rather than the whole buffer, and whatever lies past the last block
+	//   is the note's echo tail. On the GPU, whose delay states stay on the device, echoes are assumed to reach a whole buffer ahead.
+	unsigned dirtyRangeBegin[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	unsigned dirtyRangeEnd[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	// host-side copy of each voice's SynthVoiceState::arePartialsActive after its last block.
+	// Set while a note starts, and for voices that never played one, since their partials start out active.
+	bool arePartialsActiveOfVoice[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	// The envelopes (SharedEnvelope bits) that every partial of each voice is at the same point of, as they all are when a note starts.
+	// Each stays that way for as long as the parameters don't make it depend on the partial index,
+	//   but partials that join a note midway (see pickUpParameters) end the sharing until the next note.
+	// Only partial 0 then works out the envelope's block start, and the vectorized code evaluates it once per sample for the voice.
+	// Only used on the CPU, since a GPU thread has no way to wait for partial 0 to start the block. Guarded by each voice's lock.
+	unsigned sharedEnvelopesOfVoice[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	// host-side copies of each voice's SynthVoiceState::sampleBuffer and bufferLen; only change while that voice's lock is held.
+	float *sampleBufferOfVoice[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	unsigned sampleBufferLenOfVoice[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	// the number of samples allocated for each voice's buffer, of which it uses the first sampleBufferLenOfVoice.
+	// The rest is always zero, so a voice can shrink its buffer on the render thread (see shrinkIdleSampleBuffer),
+	//   and grow it back while it holds nothing, without allocating. Only changes while that voice's lock is held.
+	unsigned sampleBufferCapacityOfVoice[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	// the sample buffer length that the latest parameters need, set before any voice can pick them up
+	//   (see parameterStatesChanged), so that no voice shrinks its buffer below it in the meantime.
+	std::atomic<unsigned> latestSampleBufferLen(2 * BUFFER_BLOCK_SIZE);
 
-	void PartialState::atBlockStart(SynthState *synthState, SynthVoiceState *voiceState, unsigned partialIdx, float fundamentalFreq, bool released) {
-		ParameterStates *startParams = &voiceState->parameterInfo.start;
-		ParameterStates *endParams = &voiceState->parameterInfo.end;
-		bool didParamsChange = (voiceState->parameterInfo.start.UUID != voiceState->parameterInfo.end.UUID);
+	// An immutable copy of the parameters as of one edit, shared by every voice that renders with it.
+	// parameterStatesChanged publishes one per edit as currentSnapshot, and each voice moves on to the latest
+	//   at the start of its next block (see pickUpParameters), so an edit costs one copy however many voices there are.
+	// Snapshots are reference counted. One whose last reference goes is retired rather than freed,
+	//   since the render threads shouldn't free memory, and a voice may still be looking at it while it picks up the latest one.
+	//   The next edit frees it (see reclaimRetiredSnapshots).
+	struct ParameterSnapshot {
+		ParameterStates params;
+		// where the kernel reads params from: params itself on the CPU, a copy in device memory on the GPU
+		ParameterStates *synthStateParams;
+		// params compiled for the block setup of each partial, and the table of partials it points to
+		CompiledParameters compiled;
+		std::vector<CompiledPartialParameters> compiledPartials;
+		// likewise for compiled: compiled itself on the CPU; on the GPU, a copy in device memory that points to a copy of the table
+		CompiledParameters *synthStateCompiled;
+		CompiledPartialParameters *synthStateCompiledPartials;
+		// unique to each snapshot ever published, unlike its address (see SteadyStateCache)
+		unsigned version;
+		// the sample buffer length that a voice rendering with params needs (see requiredSampleBufferLen)
+		unsigned sampleBufferLen;
+		// one for being currentSnapshot, plus one for each start or end of a block that uses it (see startSnapshotOfVoice)
+		std::atomic<unsigned> refCount;
+		// the snapshot retired before this one (see retiredSnapshots)
+		ParameterSnapshot *nextRetired;
+		ParameterSnapshot() : synthStateParams(NULL), synthStateCompiled(NULL), synthStateCompiledPartials(NULL),
+			version(0), sampleBufferLen(0), refCount(1), nextRetired(NULL) {}
+	};
+	// the random numbers that detune each partial, for compiling parameters (see CompiledParameters)
+	RandomNumberGen randomNumbers;
+	// the most recent parameters. Only replaced while voicePoolMutex is held; set on startup.
+	std::atomic<ParameterSnapshot*> currentSnapshot(NULL);
+	// the version of the next snapshot published, and whether parameterStatesChanged has been called yet; guarded by voicePoolMutex
+	unsigned nextSnapshotVersion = 0;
+	bool hasReceivedParameters = false;
+	// the snapshots whose last reference has gone, linked through nextRetired (pushed from any thread)
+	std::atomic<ParameterSnapshot*> retiredSnapshots(NULL);
+	// the number of voices in the middle of taking a reference to currentSnapshot (see acquireCurrentSnapshot)
+	std::atomic<unsigned> numSnapshotPickupsInProgress(0);
+	// retired snapshots that a pickup may still have been looking at when they were last reclaimed; guarded by voicePoolMutex
+	std::vector<ParameterSnapshot*> snapshotsToFree;
+	// the snapshots each voice's next block starts and ends with; only change while that voice's lock is held.
+	ParameterSnapshot *startSnapshotOfVoice[MAX_SIMULTANEOUS_SYNTH_NOTES];
+	ParameterSnapshot *endSnapshotOfVoice[MAX_SIMULTANEOUS_SYNTH_NOTES];
+
+	// Once every partial of a voice plays an exact harmonic with constant amplitude and pan (and no audible echoes),
+	//   and the parameters stop changing, the voice's output repeats every period of the fundamental.
+	// The CPU code then renders one period into a wavetable and plays the voice back from it, for as long as that lasts.
+	// The partial states are still advanced every block, so the voice picks up exactly where the table leaves off.
+	// Host-only; each entry is guarded by its voice's lock.
+	struct SteadyStateCache {
+		// whether table holds the current note (cleared as soon as a block is not in steady state)
+		bool isValid;
+		// the note and parameters (ParameterSnapshot::version) the table was built for
+		float fundamentalFreq;
+		unsigned parametersVersion;
+		// position within the period (0 to 1) at the start of the next block
+		double position;
+		Wavetable table;
+		// the phase of each partial at position 0
+		std::vector<float> startPhases;
+		SteadyStateCache() : isValid(false), fundamentalFreq(0), parametersVersion(0), position(0) {}
+	};
+	SteadyStateCache steadyStateCaches[MAX_SIMULTANEOUS_SYNTH_NOTES];
+
+	// update the state of the partial stored at stateIdx for the coming block.
+	// Returns whether the partial plays exactly (partialIdx+1)*fundamentalFreq throughout the block (i.e. it is not detuned).
+	__device__ __host__ bool partialAtBlockStart(SynthState *synthState, SynthVoiceState *voiceState, unsigned stateIdx, unsigned partialIdx, float fundamentalFreq, bool released) {
+		PartialStates *partials = &synthState->partialStates;
+		// the envelopes only look at the parameters at the end of the block (numPartials of them), already compiled for this partial
+		const CompiledParameters *compiledEnd = voiceState->parameterInfo.compiledEnd;
+		const CompiledPartialParameters *partialParams = &compiledEnd->partials[partialIdx];
+		// the envelopes shared by every partial have already been started by partial 0, stored at the start of the same row
+		unsigned shared = (partialIdx == 0) ? 0 : voiceState->sharedEnvelopes;
+		unsigned sharedIdx = stateIdx - partialIdx;
 
 		// init detune envelope
-		detuneEnvelope.atBlockStart(synthState, &startParams->detuneEnvelope, &endParams->detuneEnvelope, partialIdx, released, didParamsChange);
+		DetuneEnvelopeState *detuneEnvelope = &partials->detuneEnvelopes[stateIdx];
+		float detuneWeight = voiceState->parameterInfo.compiledStart->detuneWeights[partialIdx];
+		if (shared & SharedDetuneEnvelope) {
+			detuneEnvelope->atBlockStartFrom(detuneWeight, &partials->detuneEnvelopes[sharedIdx]);
+		} else {
+			detuneEnvelope->atBlockStart(detuneWeight, &partialParams->detuneEnvelope, released);
+		}
 		
 		// init delay state
-		delayState.atBlockStart(&startParams->delayEnvelope, &endParams->delayEnvelope, partialIdx, released, didParamsChange);
+		if (shared & SharedDelayEnvelope) {
+			partials->delayStates[stateIdx] = partials->delayStates[sharedIdx];
+		} else {
+			partials->delayStates[stateIdx].atBlockStart(&partialParams->delayEnvelope, released);
+		}
 
 		// calculate the start and end frequency for this block
 		float baseFreq = (partialIdx + 1)*fundamentalFreq;
-		float detuneStart = detuneEnvelope.valueAtIdx(0);
-		float detuneEnd = detuneEnvelope.valueAtIdx(BUFFER_BLOCK_SIZE);
+		float detuneStart = detuneEnvelope->valueAtIdx(0);
+		float detuneEnd = detuneEnvelope->valueAtIdx(BUFFER_BLOCK_SIZE);
 		float freqStart = baseFreq*(1.f + detuneStart);
 		float freqEnd = baseFreq*(1.f + detuneEnd);
 
 		// configure the sinusoid to transition from the starting frequency to the end frequency
-		sinusoid.newFrequencyAndDepth(freqStart, freqEnd, 1.f, 1.f);
-		volumeEnvelope.atBlockStart(&startParams->volumeEnvelope, &endParams->volumeEnvelope, partialIdx, released, didParamsChange);
-		stereoPanEnvelope.atBlockStart(&startParams->stereoPanEnvelope, &endParams->stereoPanEnvelope, partialIdx, released, didParamsChange);
-		filterState.atBlockStart(&startParams->filterEnvelope, &endParams->filterEnvelope, freqStart, freqEnd, released, didParamsChange);
+		partials->sinusoids[stateIdx].newFrequencyAndDepth(freqStart, freqEnd, 1.f, 1.f);
+		if (shared & SharedVolumeEnvelope) {
+			partials->volumeEnvelopes[stateIdx] = partials->volumeEnvelopes[sharedIdx];
+		} else {
+			partials->volumeEnvelopes[stateIdx].atBlockStart(&partialParams->volumeEnvelope, released);
+		}
+		if (shared & SharedStereoPanEnvelope) {
+			partials->stereoPanEnvelopes[stateIdx] = partials->stereoPanEnvelopes[sharedIdx];
+		} else {
+			partials->stereoPanEnvelopes[stateIdx].atBlockStart(&partialParams->stereoPanEnvelope, released);
+		}
+		const FilterState *sharedShift = (shared & SharedFilterShift) ? &partials->filterStates[sharedIdx] : NULL;
+		partials->filterStates[stateIdx].atBlockStart(&voiceState->parameterInfo.end->filterEnvelope, &compiledEnd->filterEnvelope, freqStart, freqEnd, released, sharedShift);
+		return detuneStart == 0.f && detuneEnd == 0.f;
 	}
 
 	static void printCudaDeviveProperties(cudaDeviceProp devProp) {
@@ -522,48 +1188,433 @@ namespace kernel {
 		return hasCudaDevice() ? NUM_THREADS_PER_PARTIAL_GPU : NUM_THREADS_PER_PARTIAL_CPU;
 	}
 
+	static void* mallocSynthState(std::size_t numBytes) {
+		void *ptr;
+		if (hasCudaDevice()) {
+			checkCudaError(cudaMalloc(&ptr, numBytes));
+		} else {
+			ptr = malloc(numBytes);
+		}
+		return ptr;
+	}
+
+	static void freeSynthState(void *ptr) {
+		if (hasCudaDevice()) {
+			checkCudaError(cudaFree(ptr));
+		} else {
+			free(ptr);
+		}
+	}
+
+	static void memcpyHostToSynthState(void *dest, const void *src, std::size_t numBytes);
+	static void memcpySynthStateToHost(void *dest, const void *src, std::size_t numBytes);
+	static void memsetSynthState(void *dest, int value, std::size_t numBytes);
+
+	// copy height rows of width bytes each between two arrays (both in the synth state) whose rows are spaced differently.
+	static void memcpy2DWithinSynthState(void *dest, std::size_t destPitch, const void *src, std::size_t srcPitch, std::size_t width, std::size_t height) {
+		if (hasCudaDevice()) {
+			checkCudaError(cudaMemcpy2D(dest, destPitch, src, srcPitch, width, height, cudaMemcpyDeviceToDevice));
+		} else {
+			for (std::size_t row = 0; row < height; ++row) {
+				memcpy((char*)dest + row*destPitch, (const char*)src + row*srcPitch, width);
+			}
+		}
+	}
+
+	// set count elements of the synth state, starting at dest, to their default-constructed value.
+	template <typename T> static void resetSynthStateArray(T *dest, unsigned count) {
+		// copy from a bounded batch of defaults, so that huge arrays don't need an equally huge host copy.
+		unsigned batchSize = std::min(count, 1024u);
+		T *defaults = new T[batchSize];
+		for (unsigned i = 0; i < count; i += batchSize) {
+			memcpyHostToSynthState(dest + i, defaults, std::min(batchSize, count - i)*sizeof(T));
+		}
+		delete[] defaults;
+	}
+
+	// reallocate one component's array from oldLayout to newLayout.
+	// If only the capacity changed, each partial keeps its state; everything else starts out default-constructed.
+	template <typename T> static void resizePartialStateArray(T **array, const PartialStates &oldLayout, const PartialStates &newLayout) {
+		unsigned numRows = newLayout.numVoices*newLayout.threadsPerPartial;
+		// plus the row of defaults (see PartialStates::defaultsIdx), which the rows kept below never overwrite
+		T *resized = (T*)mallocSynthState((numRows + 1)*newLayout.capacity*sizeof(T));
+		resetSynthStateArray(resized, (numRows + 1)*newLayout.capacity);
+		if (*array != NULL) {
+			if (oldLayout.numVoices == newLayout.numVoices && oldLayout.threadsPerPartial == newLayout.threadsPerPartial) {
+				unsigned numKept = std::min(oldLayout.capacity, newLayout.capacity);
+				memcpy2DWithinSynthState(resized, newLayout.capacity*sizeof(T), *array, oldLayout.capacity*sizeof(T), numKept*sizeof(T), numRows);
+			}
+			freeSynthState(*array);
+		}
+		*array = resized;
+	}
+
+	// lay out the partial states for numVoices voices of up to capacity partials each.
+	// Caller must hold every voice lock.
+	static void resizePartialStates(unsigned numVoices, unsigned capacity) {
+		PartialStates resized = d_partialStates;
+		resized.numVoices = numVoices;
+		// only as many rows per voice as the backend in use renders with (hasCudaDevice never changes after startup)
+		resized.threadsPerPartial = numThreadsPerPartial();
+		resized.capacity = capacity;
+		resizePartialStateArray(&resized.sinusoids, d_partialStates, resized);
+		resizePartialStateArray(&resized.volumeEnvelopes, d_partialStates, resized);
+		resizePartialStateArray(&resized.stereoPanEnvelopes, d_partialStates, resized);
+		resizePartialStateArray(&resized.detuneEnvelopes, d_partialStates, resized);
+		resizePartialStateArray(&resized.delayStates, d_partialStates, resized);
+		resizePartialStateArray(&resized.filterStates, d_partialStates, resized);
+		d_partialStates = resized;
+		// let the device-side state know where the partial states now live
+		memcpyHostToSynthState(&d_synthState->partialStates, &d_partialStates, sizeof(d_partialStates));
+	}
+
+	// Caller must hold every voice lock.
+	static void freePartialStates() {
+		freeSynthState(d_partialStates.sinusoids);
+		freeSynthState(d_partialStates.volumeEnvelopes);
+		freeSynthState(d_partialStates.stereoPanEnvelopes);
+		freeSynthState(d_partialStates.detuneEnvelopes);
+		freeSynthState(d_partialStates.delayStates);
+		freeSynthState(d_partialStates.filterStates);
+		d_partialStates = PartialStates();
+	}
+
+	// set count elements of one component's array, starting at idx, to their default by copying from its row of defaults.
+	// Unlike resetSynthStateArray, this allocates nothing, so it's fit for note starts.
+	template <typename T> static void resetPartialStateArray(T *array, unsigned idx, unsigned count) {
+		std::size_t numBytes = count*sizeof(T);
+		memcpy2DWithinSynthState(array + idx, numBytes, array + d_partialStates.defaultsIdx(), numBytes, numBytes, 1);
+	}
+
+	// return partials [firstPartial, endPartial) of voiceNum to their note-off state.
+	// Caller must hold the lock of voiceNum.
+	static void resetPartialStates(unsigned voiceNum, unsigned firstPartial, unsigned endPartial) {
+		unsigned count = endPartial - firstPartial;
+		for (unsigned t = 0; t < d_partialStates.threadsPerPartial; ++t) {
+			unsigned idx = d_partialStates.indexOf(voiceNum, t, firstPartial);
+			resetPartialStateArray(d_partialStates.sinusoids, idx, count);
+			resetPartialStateArray(d_partialStates.volumeEnvelopes, idx, count);
+			resetPartialStateArray(d_partialStates.stereoPanEnvelopes, idx, count);
+			resetPartialStateArray(d_partialStates.detuneEnvelopes, idx, count);
+			resetPartialStateArray(d_partialStates.delayStates, idx, count);
+			resetPartialStateArray(d_partialStates.filterStates, idx, count);
+		}
+	}
+
+	// the sample buffer length (a power of two) that a voice needs for the block it renders, the block before it
+	//   (zeroed while the next one renders) and the furthest echo that params can produce.
+	static unsigned requiredSampleBufferLen(const ParameterStates *params) {
+		unsigned neededLen = 2 * BUFFER_BLOCK_SIZE + maxEchoReach(&params->delayEnvelope);
+		unsigned len = 2 * BUFFER_BLOCK_SIZE;
+		while (len < neededLen && len < CIRCULAR_BUFFER_LEN) {
+			len *= 2;
+		}
+		return len;
+	}
+
+	// a zeroed sample buffer of len samples
+	static float* allocateSampleBuffer(unsigned len) {
+		float *buffer = (float*)mallocSynthState(len*NUM_CH*sizeof(float));
+		memsetSynthState(buffer, 0, len*NUM_CH*sizeof(float));
+		return buffer;
+	}
+
+	// set the number of samples of its buffer that voiceNum uses, here and on the device
+	// Caller must hold the lock of voiceNum.
+	static void setSampleBufferLen(unsigned voiceNum, unsigned len) {
+		sampleBufferLenOfVoice[voiceNum] = len;
+		memcpyHostToSynthState(&d_voiceStates[voiceNum].bufferLen, &len, sizeof(len));
+	}
+
+	// give voiceNum the zeroed sample buffer resized, of newLen samples, which then holds whatever the old one did
+	//   at the same absolute indices, so a playing note doesn't lose its pending echoes.
+	// Returns the old buffer, for the caller to free once it has let go of the voice's lock.
+	// Caller must hold the lock of voiceNum.
+	static float* swapInSampleBuffer(unsigned voiceNum, float *resized, unsigned newLen) {
+		float *old = sampleBufferOfVoice[voiceNum];
+		if (old != NULL) {
+			unsigned oldLen = sampleBufferLenOfVoice[voiceNum];
+			// on the CPU, only the dirty range can hold samples. The GPU's is only a bound, so carry over one lap of the old buffer.
+			unsigned begin = dirtyRangeBegin[voiceNum];
+			unsigned length = hasCudaDevice() ? oldLen : std::min(dirtyRangeEnd[voiceNum] - begin, oldLen);
+			for (unsigned i = 0; i < length;) {
+				// copy up to wherever either buffer wraps around
+				unsigned oldPos = (begin + i) % oldLen;
+				unsigned newPos = (begin + i) % newLen;
+				unsigned numCopied = std::min(length - i, std::min(oldLen - oldPos, newLen - newPos));
+				std::size_t numBytes = numCopied*NUM_CH*sizeof(float);
+				memcpy2DWithinSynthState(&resized[NUM_CH*newPos], numBytes, &old[NUM_CH*oldPos], numBytes, numBytes, 1);
+				i += numCopied;
+			}
+		}
+		sampleBufferOfVoice[voiceNum] = resized;
+		sampleBufferCapacityOfVoice[voiceNum] = newLen;
+		setSampleBufferLen(voiceNum, newLen);
+		// let the device-side state know where its buffer now lives
+		memcpyHostToSynthState(&d_voiceStates[voiceNum].sampleBuffer, &resized, sizeof(resized));
+		return old;
+	}
+
+	// make sure voiceNum's sample buffer is at least newLen samples long, keeping whatever it holds.
+	// Only called off the render thread, so that a render thread never allocates or frees a buffer:
+	//   the new one is allocated before taking the voice's lock, and the old one freed after letting go of it.
+	// Caller must hold voicePoolMutex, and not the lock of voiceNum.
+	static void growSampleBuffer(unsigned voiceNum, unsigned newLen) {
+		std::unique_lock<std::mutex> stateLock(voiceStateMutexes[voiceNum]);
+		if (newLen <= sampleBufferLenOfVoice[voiceNum]) {
+			return;
+		}
+		if (newLen <= sampleBufferCapacityOfVoice[voiceNum] && !hasCudaDevice() && dirtyRangeBegin[voiceNum] == dirtyRangeEnd[voiceNum]) {
+			// the buffer holds nothing, and everything past the part in use is zero already
+			setSampleBufferLen(voiceNum, newLen);
+			return;
+		}
+		stateLock.unlock();
+		float *grown = allocateSampleBuffer(newLen);
+		// the voice may have rendered (or shrunk its buffer) in the meantime, but not below newLen (see latestSampleBufferLen)
+		stateLock.lock();
+		float *old = swapInSampleBuffer(voiceNum, grown, newLen);
+		stateLock.unlock();
+		freeSynthState(old);
+	}
+
+	// a new snapshot of params (or of the defaults, if NULL), holding the one reference it will have as currentSnapshot.
+	// Caller must hold voicePoolMutex.
+	static ParameterSnapshot* newParameterSnapshot(const ParameterStates *params) {
+		ParameterSnapshot *snapshot = new ParameterSnapshot();
+		if (params != NULL) {
+			snapshot->params = *params;
+		}
+		snapshot->version = nextSnapshotVersion++;
+		snapshot->sampleBufferLen = requiredSampleBufferLen(&snapshot->params);
+		unsigned numPartials = snapshot->params.numPartials;
+		snapshot->compiledPartials.resize(numPartials);
+		snapshot->compiled.compile(&snapshot->params, &randomNumbers, &snapshot->compiledPartials[0]);
+		if (hasCudaDevice()) {
+			snapshot->synthStateParams = (ParameterStates*)mallocSynthState(sizeof(ParameterStates));
+			memcpyHostToSynthState(snapshot->synthStateParams, &snapshot->params, sizeof(ParameterStates));
+			snapshot->synthStateCompiledPartials = (CompiledPartialParameters*)mallocSynthState(numPartials*sizeof(CompiledPartialParameters));
+			memcpyHostToSynthState(snapshot->synthStateCompiledPartials, &snapshot->compiledPartials[0], numPartials*sizeof(CompiledPartialParameters));
+			CompiledParameters *compiledCopy = new CompiledParameters(snapshot->compiled);
+			compiledCopy->partials = snapshot->synthStateCompiledPartials;
+			snapshot->synthStateCompiled = (CompiledParameters*)mallocSynthState(sizeof(CompiledParameters));
+			memcpyHostToSynthState(snapshot->synthStateCompiled, compiledCopy, sizeof(CompiledParameters));
+			delete compiledCopy;
+		} else {
+			snapshot->synthStateParams = &snapshot->params;
+			snapshot->synthStateCompiled = &snapshot->compiled;
+			snapshot->synthStateCompiledPartials = &snapshot->compiledPartials[0];
+		}
+		return snapshot;
+	}
+
+	static void deleteParameterSnapshot(ParameterSnapshot *snapshot) {
+		if (hasCudaDevice()) {
+			freeSynthState(snapshot->synthStateParams);
+			freeSynthState(snapshot->synthStateCompiled);
+			freeSynthState(snapshot->synthStateCompiledPartials);
+		}
+		delete snapshot;
+	}
+
+	// take a reference to whatever currentSnapshot is at the time
+	static ParameterSnapshot* acquireCurrentSnapshot() {
+		++numSnapshotPickupsInProgress;
+		ParameterSnapshot *snapshot;
+		unsigned refCount;
+		do {
+			snapshot = currentSnapshot.load();
+			refCount = snapshot->refCount.load();
+			// once the count drops to 0 it stays there: the snapshot has been replaced (and retired) since we loaded it,
+			//   so try the one that replaced it.
+			while (refCount != 0 && !snapshot->refCount.compare_exchange_weak(refCount, refCount + 1)) {}
+		} while (refCount == 0);
+		--numSnapshotPickupsInProgress;
+		return snapshot;
+	}
+
+	// drop a reference to snapshot, retiring it if that was the last one. Never blocks.
+	static void releaseSnapshot(ParameterSnapshot *snapshot) {
+		if (snapshot == NULL || --snapshot->refCount != 0) {
+			return;
+		}
+		ParameterSnapshot *head = retiredSnapshots.load();
+		do {
+			snapshot->nextRetired = head;
+		} while (!retiredSnapshots.compare_exchange_weak(head, snapshot));
+	}
+
+	// free the snapshots retired so far, unless a voice may still be looking at one of them.
+	// Caller must hold voicePoolMutex.
+	static void reclaimRetiredSnapshots() {
+		for (ParameterSnapshot *snapshot = retiredSnapshots.exchange(NULL); snapshot != NULL; snapshot = snapshot->nextRetired) {
+			snapshotsToFree.push_back(snapshot);
+		}
+		// a pickup that loaded one of them as currentSnapshot began before it was retired, and only looks at it until it is done.
+		// Pickups that begin later load a newer one. Otherwise leave them for the next edit.
+		if (numSnapshotPickupsInProgress != 0) {
+			return;
+		}
+		for (std::size_t i = 0; i < snapshotsToFree.size(); ++i) {
+			deleteParameterSnapshot(snapshotsToFree[i]);
+		}
+		snapshotsToFree.clear();
+	}
+
+	// point the device-side state of voiceNum at the snapshots its next block uses
+	// Caller must hold the lock of voiceNum.
+	static void copyParameterInfoToSynthState(unsigned voiceNum) {
+		FullBlockParameterInfo parameterInfo;
+		parameterInfo.start = startSnapshotOfVoice[voiceNum]->synthStateParams;
+		parameterInfo.end = endSnapshotOfVoice[voiceNum]->synthStateParams;
+		parameterInfo.compiledStart = startSnapshotOfVoice[voiceNum]->synthStateCompiled;
+		parameterInfo.compiledEnd = endSnapshotOfVoice[voiceNum]->synthStateCompiled;
+		memcpyHostToSynthState(&d_voiceStates[voiceNum].parameterInfo, &parameterInfo, sizeof(parameterInfo));
+	}
+
+	// Move voiceNum on to the block it is about to render: it ends with the latest parameters,
+	//   and starts with the ones the last block ended with (if shouldGlide) or with the latest as well.
+	// New parameters may need more partials, which are set up here rather than by every edit.
+	// parameterStatesChanged has already made the voice's sample buffer long enough for them.
+	// Caller must hold the lock of voiceNum.
+	static void pickUpParameters(unsigned voiceNum, bool shouldGlide) {
+		ParameterSnapshot *prevStart = startSnapshotOfVoice[voiceNum];
+		ParameterSnapshot *prevEnd = endSnapshotOfVoice[voiceNum];
+		// the voice's reference keeps prevEnd alive, so if currentSnapshot has its address, it is the same snapshot
+		if (prevStart == prevEnd && currentSnapshot.load() == prevEnd) {
+			// the usual case: nothing changed over the last block, nor since
+			return;
+		}
+		ParameterSnapshot *latest = acquireCurrentSnapshot();
+		ParameterSnapshot *start = shouldGlide ? prevEnd : latest;
+		// we already hold a reference to it, so it can't be retired in the meantime
+		++start->refCount;
+		startSnapshotOfVoice[voiceNum] = start;
+		endSnapshotOfVoice[voiceNum] = latest;
+		copyParameterInfoToSynthState(voiceNum);
+
+		if (latest != prevEnd) {
+			// parameterStatesChanged made room for them before publishing latest
+			unsigned numPartials = latest->params.numPartials;
+			if (numPartials > numPartialsOfVoice[voiceNum]) {
+				// partials joining a note mid-way start from their note-off state, not from whatever an earlier note left there.
+				resetPartialStates(voiceNum, numPartialsOfVoice[voiceNum], numPartials);
+				sharedEnvelopesOfVoice[voiceNum] = 0;
+			}
+			numPartialsOfVoice[voiceNum] = numPartials;
+		}
+		releaseSnapshot(prevStart);
+		releaseSnapshot(prevEnd);
+	}
+
+	// Caller must hold every voice lock.
+	static void freeVoiceStates() {
+		for (unsigned i = 0; i < numVoiceStates; ++i) {
+			freeSynthState(sampleBufferOfVoice[i]);
+			sampleBufferOfVoice[i] = NULL;
+			sampleBufferLenOfVoice[i] = sampleBufferCapacityOfVoice[i] = 0;
+			releaseSnapshot(startSnapshotOfVoice[i]);
+			releaseSnapshot(endSnapshotOfVoice[i]);
+			startSnapshotOfVoice[i] = endSnapshotOfVoice[i] = NULL;
+		}
+		if (d_voiceStates != NULL) {
+			freeSynthState(d_voiceStates);
+			d_voiceStates = NULL;
+			numVoiceStates = 0;
+		}
+		freePartialStates();
+	}
+
+	// (re)allocate the state for numVoices voices, initialized to their note-off state with the latest parameters.
+	// Caller must hold voicePoolMutex and every voice lock.
+	static void allocateVoiceStates(unsigned numVoices) {
+		freeVoiceStates();
+		SynthVoiceState *defaultVoiceState = new SynthVoiceState();
+		// every voice starts out holding two references to the latest parameters (see pickUpParameters)
+		ParameterSnapshot *latest = currentSnapshot.load();
+		const ParameterStates *params = &latest->params;
+		defaultVoiceState->parameterInfo.start = defaultVoiceState->parameterInfo.end = latest->synthStateParams;
+		defaultVoiceState->parameterInfo.compiledStart = defaultVoiceState->parameterInfo.compiledEnd = latest->synthStateCompiled;
+		d_voiceStates = (SynthVoiceState*)mallocSynthState(numVoices*sizeof(SynthVoiceState));
+		for (unsigned i = 0; i < numVoices; ++i) {
+			memcpyHostToSynthState(&d_voiceStates[i], defaultVoiceState, sizeof(SynthVoiceState));
+		}
+		numVoiceStates = numVoices;
+		// let the device-side state know where its voices now live
+		memcpyHostToSynthState(&d_synthState->voiceStates, &d_voiceStates, sizeof(d_voiceStates));
+		unsigned bufferLen = latest->sampleBufferLen;
+		for (unsigned i = 0; i < numVoices; ++i) {
+			startSnapshotOfVoice[i] = acquireCurrentSnapshot();
+			endSnapshotOfVoice[i] = acquireCurrentSnapshot();
+			dirtyRangeBegin[i] = dirtyRangeEnd[i] = 0;
+			arePartialsActiveOfVoice[i] = true;
+			swapInSampleBuffer(i, allocateSampleBuffer(bufferLen), bufferLen);
+		}
+		delete defaultVoiceState;
+
+		unsigned numPartials = params->numPartials;
+		resizePartialStates(numVoices, numPartials);
+		for (unsigned i = 0; i < numVoices; ++i) {
+			numPartialsOfVoice[i] = numPartials;
+			sharedEnvelopesOfVoice[i] = AllSharedEnvelopes;
+			steadyStateCaches[i].isValid = false;
+		}
+	}
+
+	static void lockAllVoices() {
+		for (int i = 0; i < MAX_SIMULTANEOUS_SYNTH_NOTES; ++i) {
+			voiceStateMutexes[i].lock();
+		}
+	}
+
+	static void unlockAllVoices() {
+		for (int i = 0; i < MAX_SIMULTANEOUS_SYNTH_NOTES; ++i) {
+			voiceStateMutexes[i].unlock();
+		}
+	}
+
 	// code to run at shutdown (free buffers, etc)
 	static void teardown() {
-		std::unique_lock<std::mutex> stateLock(synthStateMutex);
+		std::unique_lock<std::mutex> poolLock(voicePoolMutex);
+		// wait for any in-progress voice to finish with the state
+		lockAllVoices();
 		// free the sample buffer if we allocated it and it hasn't already been freed.
 		if (d_synthState != NULL) {
-			if (hasCudaDevice()) {
-				checkCudaError(cudaFree(d_synthState));
-			} else {
-				free(d_synthState);
-			}
+			freeVoiceStates();
+			freeSynthState(d_synthState);
 			// avoid double-frees
 			d_synthState = NULL;
+			// no voice is left to pick up the parameters
+			releaseSnapshot(currentSnapshot.exchange(NULL));
+			reclaimRetiredSnapshots();
 		}
+		unlockAllVoices();
 	}
 
 	// code to run on first-time audio calculation
 	static void startup() {
 		atexit(&teardown);
-		std::unique_lock<std::mutex> stateLock(synthStateMutex);
+		std::unique_lock<std::mutex> poolLock(voicePoolMutex);
 		SynthState *defaultState = new SynthState();
-		if (hasCudaDevice()) {
-			// allocate sample buffer on device
-			checkCudaError(cudaMalloc(&d_synthState, sizeof(SynthState)));
-			checkCudaError(cudaMemcpy(d_synthState, defaultState, sizeof(SynthState), cudaMemcpyHostToDevice));
-		} else {
-			// allocate sample buffer on cpu
-			d_synthState = (SynthState*)malloc(sizeof(SynthState));
-			memcpy(d_synthState, defaultState, sizeof(SynthState));
-		}
+		// allocate sample buffer on device (or cpu)
+		d_synthState = (SynthState*)mallocSynthState(sizeof(SynthState));
+		memcpyHostToSynthState(d_synthState, defaultState, sizeof(SynthState));
 		delete defaultState;
+		// the default parameters, until parameterStatesChanged is first called
+		currentSnapshot = newParameterSnapshot(NULL);
+		latestSampleBufferLen = currentSnapshot.load()->sampleBufferLen;
+		allocateVoiceStates(requestedNumVoiceStates);
+		cpuBackend = simd::detectBestBackend();
+		ifft::init();
 	}
 
 	static void doStartupOnce() {
-		static bool hasInit = false;
-		if (!hasInit) {
-			startup();
-			hasInit = true;
-		}
+		// voices may start rendering from several threads at once
+		std::call_once(startupFlag, &startup);
 	}
 
 	// called for each partial to sum their outputs together.
-	__device__ __host__ void reduceOutputs(SynthVoiceState *voiceState, unsigned partialIdx, int sampleIdx, float outputL, float outputR) {
+	__device__ __host__ void reduceOutputs(SynthVoiceState *voiceState, unsigned partialIdx, unsigned numPartials, int sampleIdx, float outputL, float outputR) {
 		//algorithm: given 8 outputs, [0, 1, 2, 3, 4, 5, 6, 7]
 		//first iteration: 4 active threads. 
 		//  Thread 0 adds i0 to i(0+4). Thread 1 adds i1 to i(1+4). Thread 2 adds i2 to i(2+4). Thread 3 adds i3 to i(3+4)
@@ -575,18 +1626,24 @@ namespace kernel {
 		//  Thread 0 adds i0 to i(0+1).
 		//  Output now: [28,   16, 8, 10, 4, 5, 6, 7]
 		//fourth iteration: 0 active threads -> exit
-		unsigned bufferIdx = NUM_CH * (sampleIdx % CIRCULAR_BUFFER_LEN);
+		unsigned bufferIdx = voiceState->bufferIdxOf(sampleIdx);
 #ifdef __CUDA_ARCH__
 		//device code
 		// This reduction method requires a temporary array in shared memory.
-		__shared__ float partialReductionOutputs[NUM_PARTIALS*NUM_CH];
+		__shared__ float partialReductionOutputs[MAX_PARTIALS*NUM_CH];
 
 		partialReductionOutputs[NUM_CH*partialIdx + 0] = outputL;
 		partialReductionOutputs[NUM_CH*partialIdx + 1] = outputR;
-		unsigned numActiveThreads = NUM_PARTIALS / 2;
+		// start from half the next power of 2, so that any number of partials can be reduced:
+		//   threads whose partner lies past the last partial just sit out the first iteration.
+		unsigned numActiveThreads = 1;
+		while (numActiveThreads < numPartials) {
+			numActiveThreads *= 2;
+		}
+		numActiveThreads /= 2;
 		while (numActiveThreads > 0) {
 			__syncthreads();
-			if (partialIdx < numActiveThreads) {
+			if (partialIdx < numActiveThreads && partialIdx + numActiveThreads < numPartials) {
 				partialReductionOutputs[NUM_CH*partialIdx + 0] += partialReductionOutputs[NUM_CH*partialIdx + numActiveThreads*NUM_CH + 0];
 				partialReductionOutputs[NUM_CH*partialIdx + 1] += partialReductionOutputs[NUM_CH*partialIdx + numActiveThreads*NUM_CH + 1];
 			}
@@ -594,7 +1651,7 @@ namespace kernel {
 		}
 		if (partialIdx == 0) {
 			// zero the previous frame's outputs so delay effect can fill them
-			unsigned prevIdx = NUM_CH * ((CIRCULAR_BUFFER_LEN + sampleIdx - BUFFER_BLOCK_SIZE) % CIRCULAR_BUFFER_LEN);
+			unsigned prevIdx = voiceState->bufferIdxOf(sampleIdx - BUFFER_BLOCK_SIZE);
 			
 			voiceState->sampleBuffer[prevIdx + 0] = 0;
 			voiceState->sampleBuffer[prevIdx + 1] = 0;
@@ -609,11 +1666,13 @@ namespace kernel {
 		}
 #else
 		//host code
+		// the partials are summed one by one, so there is no reduction to size
+		(void)numPartials;
 		//Since everything's computed iteratively, we can just add our outputs directly to the buffer.
 		//First write to this sample must zero-initialize the buffer (not required in the GPU code).
 		if (partialIdx == 0) {
 			// zero the previous frame's outputs so delay effect can fill them
-			unsigned prevIdx = NUM_CH * ((CIRCULAR_BUFFER_LEN + sampleIdx - BUFFER_BLOCK_SIZE) % CIRCULAR_BUFFER_LEN);
+			unsigned prevIdx = voiceState->bufferIdxOf(sampleIdx - BUFFER_BLOCK_SIZE);
 			voiceState->sampleBuffer[prevIdx + 0] = 0;
 			voiceState->sampleBuffer[prevIdx + 1] = 0;
 		}
@@ -623,7 +1682,7 @@ namespace kernel {
 	}
 
 	// called for each partial to sum their outputs together.
-	__device__ __host__ void reduceDelayOutputs(SynthVoiceState *voiceState, unsigned partialIdx, int sampleIdx, float outputL, float outputR) {
+	__device__ __host__ void reduceDelayOutputs(SynthVoiceState *voiceState, unsigned /*partialIdx*/, int sampleIdx, float outputL, float outputR) {
 		//algorithm: given 8 outputs, [0, 1, 2, 3, 4, 5, 6, 7]
 		//first iteration: 4 active threads. 
 		//  Thread 0 adds i0 to i(0+4). Thread 1 adds i1 to i(1+4). Thread 2 adds i2 to i(2+4). Thread 3 adds i3 to i(3+4)
@@ -635,7 +1694,7 @@ namespace kernel {
 		//  Thread 0 adds i0 to i(0+1).
 		//  Output now: [28,   16, 8, 10, 4, 5, 6, 7]
 		//fourth iteration: 0 active threads -> exit
-		unsigned bufferIdx = NUM_CH * (sampleIdx % CIRCULAR_BUFFER_LEN);
+		unsigned bufferIdx = voiceState->bufferIdxOf(sampleIdx);
 #ifdef __CUDA_ARCH__
 		//device code
 		atomicAdd(&voiceState->sampleBuffer[bufferIdx + 0], outputL);
@@ -647,25 +1706,11 @@ namespace kernel {
 #endif
 	}
 
-	// called at the end of the block.
-	// if parameterInfo.start != parameterInfo.end, then we copy the end parameters of this block to the start parameters for the next block.
-	// this needs to be called for each sine wave.
-	__device__ __host__ void updateVoiceParametersIfNeeded(SynthVoiceState *voiceState, unsigned voiceNum, unsigned partialIdx) {
-		/*int transferSize = 16;
-		int totalBytesToCopy = sizeof(ParameterStates);
-		int numTransfers = (totalBytesToCopy + transferSize - 1) / transferSize;
-		int numTransfersPerThread = (numTransfers + NUM_PARTIALS - 1) / NUM_PARTIALS;*/
-		if (voiceState->parameterInfo.start.UUID != voiceState->parameterInfo.end.UUID) {
-			if (partialIdx == NUM_PARTIALS - 1) {
-				memcpy(&voiceState->parameterInfo.start, &voiceState->parameterInfo.end, sizeof(ParameterStates));
-			}
-		}
-	}
-
+	// angularFreq is in rad/sample
 	__device__ __host__ float antiAliasedVolumeForFreq(float angularFreq) {
-		float falloffWidth = 4000.f;
-		float invFalloffWidth = 0.00025f;
-		float falloffEnd = 0.5f*SAMPLE_RATE_RAD;
+		float falloffWidth = ANTI_ALIAS_FALLOFF_WIDTH;
+		float invFalloffWidth = 1.f / ANTI_ALIAS_FALLOFF_WIDTH;
+		float falloffEnd = ANTI_ALIAS_FALLOFF_END;
 		float falloffStart = falloffEnd - falloffWidth;
 		
 		float clamped = min(falloffEnd, max(falloffStart, angularFreq));
@@ -673,25 +1718,112 @@ namespace kernel {
 		return level;
 	}
 
+	// whether the partial stored at stateIdx (whose block has started) can be heard at all during the block.
+	// Inaudible ones are skipped entirely. Their states still advance every block (see partialAtBlockStart),
+	//   so they come back in phase once they can be heard again.
+	__device__ __host__ bool isPartialAudible(const SynthVoiceState *voiceState, const PartialStates *partials, unsigned stateIdx, unsigned partialIdx) {
+		if (voiceState->parameterInfo.start->partialLevels[partialIdx] == 0.f || partials->filterStates[stateIdx].isSilentOverBlock()) {
+			return false;
+		}
+		// the frequency changes linearly over the block and the anti-aliasing envelope falls as it rises,
+		//   so if both ends of the block are at or past Nyquist (where the envelope reaches 0, up to rounding), all of it is muted.
+		const Sinusoidal *sinusoidState = &partials->sinusoids[stateIdx];
+		return sinusoidState->freqAtIdx(0) < ANTI_ALIAS_FALLOFF_END || sinusoidState->freqAtIdx(BUFFER_BLOCK_SIZE) < ANTI_ALIAS_FALLOFF_END;
+	}
+
+	// whether every partial's echoes follow the same envelopes, in which case they are the echoes of the voice's summed output
+	__device__ __host__ bool areEchoesSharedByPartials(const SynthVoiceState *voiceState) {
+		return !voiceState->parameterInfo.start->delayEnvelope.dependsOnPartialIdx() && !voiceState->parameterInfo.end->delayEnvelope.dependsOnPartialIdx();
+	}
+
+	// The delay effect as a post-mix stage: rather than every partial adding MAX_DELAY_ECHOES copies of itself
+	//   to the buffer for every sample, the partials render the block dry and its echoes are added once.
+	// The three steps below are each called for every sample of the block (sampleIdx), in order.
+
+	// before the partials render the block at baseIdx: decide whether its echoes will be mixed,
+	//   and if so, move the echoes that earlier blocks left in the block out of the way.
+	__device__ __host__ void setAsideEarlierEchoes(SynthVoiceState *voiceState, unsigned baseIdx, unsigned sampleIdx) {
+		bool areEchoesMixed = areEchoesSharedByPartials(voiceState);
+		if (sampleIdx == 0) {
+			voiceState->areEchoesMixed = areEchoesMixed;
+		}
+		if (areEchoesMixed) {
+			unsigned bufferIdx = voiceState->bufferIdxOf(baseIdx + sampleIdx);
+			voiceState->echoScratch[NUM_CH*sampleIdx + 0] = voiceState->sampleBuffer[bufferIdx + 0];
+			voiceState->echoScratch[NUM_CH*sampleIdx + 1] = voiceState->sampleBuffer[bufferIdx + 1];
+			voiceState->sampleBuffer[bufferIdx + 0] = 0;
+			voiceState->sampleBuffer[bufferIdx + 1] = 0;
+		}
+	}
+
+	// once the partials are done: put the earlier echoes back, keeping the dry output in echoScratch
+	__device__ __host__ void restoreEarlierEchoes(SynthVoiceState *voiceState, unsigned baseIdx, unsigned sampleIdx) {
+		if (!voiceState->areEchoesMixed) {
+			return;
+		}
+		unsigned bufferIdx = voiceState->bufferIdxOf(baseIdx + sampleIdx);
+		for (unsigned ch = 0; ch < NUM_CH; ++ch) {
+			float dry = voiceState->sampleBuffer[bufferIdx + ch];
+			voiceState->sampleBuffer[bufferIdx + ch] = dry + voiceState->echoScratch[NUM_CH*sampleIdx + ch];
+			voiceState->echoScratch[NUM_CH*sampleIdx + ch] = dry;
+		}
+	}
+
+	// add the echoes of the dry output at sampleIdx, exactly where computePartialOutput would have put them.
+	// Every partial's delay state is the same, so partial 0's is used.
+	__device__ __host__ void mixEchoesOfSample(SynthState *synthState, unsigned voiceNum, unsigned baseIdx, unsigned sampleIdx) {
+		SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
+		if (!voiceState->areEchoesMixed) {
+			return;
+		}
+		PartialStates *partials = &synthState->partialStates;
+		const DelayEnvelopeState *delayState = &partials->delayStates[partials->indexOf(voiceNum, 0, 0)];
+		float dryL = voiceState->echoScratch[NUM_CH*sampleIdx + 0];
+		float dryR = voiceState->echoScratch[NUM_CH*sampleIdx + 1];
+		unsigned delayPerEchoInSamples = delayState->spaceBetweenEchoesAtIdx(sampleIdx)*SAMPLE_RATE;
+		float ampLossPerEcho = delayState->amplitudeLostPerEchoAtIdx(sampleIdx);
+		for (unsigned echoVoiceIdx = 1; echoVoiceIdx <= MAX_DELAY_ECHOES; ++echoVoiceIdx) {
+			float curAmp = 1.f - echoVoiceIdx*ampLossPerEcho;
+			if (!(curAmp > 0.f)) {
+				// silent echo: adding it would not change the buffer
+				continue;
+			}
+			unsigned absDelayIdx = baseIdx + sampleIdx + echoVoiceIdx + echoVoiceIdx * delayPerEchoInSamples;
+			reduceDelayOutputs(voiceState, 0, absDelayIdx, curAmp*dryL, curAmp*dryR);
+		}
+	}
+
 	// compute the output for ONE sine wave over a section of the current sample block
-	__device__ __host__ void computePartialOutput(SynthState *synthState, unsigned voiceNum, unsigned baseIdx, unsigned partialIdx, unsigned samplesPerThread, unsigned threadIdWithinPartial, float fundamentalFreq, bool released) {
+	__device__ __host__ void computePartialOutput(SynthState *synthState, unsigned voiceNum, unsigned baseIdx, unsigned partialIdx, unsigned numPartials, unsigned samplesPerThread, unsigned threadIdWithinPartial, float fundamentalFreq, bool released) {
 		SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
-		PartialState* myState = &voiceState->partialStates[threadIdWithinPartial][partialIdx];
-		myState->atBlockStart(synthState, voiceState, partialIdx, fundamentalFreq, released);
+		PartialStates *partials = &synthState->partialStates;
+		unsigned stateIdx = partials->indexOf(voiceNum, threadIdWithinPartial, partialIdx);
+		partialAtBlockStart(synthState, voiceState, stateIdx, partialIdx, fundamentalFreq, released);
+		const Sinusoidal *sinusoidState = &partials->sinusoids[stateIdx];
+		const FilterState *filterState = &partials->filterStates[stateIdx];
+		const ADSRLFOEnvelopeState *volumeEnvelope = &partials->volumeEnvelopes[stateIdx];
+		const ADSRLFOEnvelopeState *stereoPanEnvelope = &partials->stereoPanEnvelopes[stateIdx];
+		const DelayEnvelopeState *delayState = &partials->delayStates[stateIdx];
 		// Get the base partial level (the hand-drawn frequency weights)
-		float level = voiceState->parameterInfo.start.partialLevels[partialIdx];
+		float level = voiceState->parameterInfo.start->partialLevels[partialIdx];
+		bool isAudible = isPartialAudible(voiceState, partials, stateIdx, partialIdx);
 		for (unsigned sampleIdx = threadIdWithinPartial*samplesPerThread; sampleIdx < (threadIdWithinPartial+1)*samplesPerThread; ++sampleIdx) {
+			if (!isAudible) {
+				// nothing to add or echo, but every partial must still take part in the reduction
+				reduceOutputs(voiceState, partialIdx, numPartials, baseIdx + sampleIdx, 0.f, 0.f);
+				continue;
+			}
 			// Extract the sinusoidal portion of the wave.
-			float sinusoid = myState->sinusoid.valueAtIdx(sampleIdx);
+			float sinusoid = sinusoidState->valueAtIdx(sampleIdx);
 
 			// Compute the filter envelope and a secondary envelope that prevents aliasing
-			float freq = myState->sinusoid.freqAtIdx(sampleIdx);
+			float freq = sinusoidState->freqAtIdx(sampleIdx);
 			float antiAliasEnv = antiAliasedVolumeForFreq(freq);
-			float filterEnv = myState->filterState.valueAtIdx(sampleIdx);
+			float filterEnv = filterState->valueAtIdx(sampleIdx);
 
 			// Get the ADSR/LFO volume envelope
-			float envelope = antiAliasEnv*filterEnv*myState->volumeEnvelope.productAtIdx(sampleIdx);
-			float pan = myState->stereoPanEnvelope.sumAtIdx(sampleIdx);
+			float envelope = antiAliasEnv*filterEnv*volumeEnvelope->productAtIdx(sampleIdx);
+			float pan = stereoPanEnvelope->sumAtIdx(sampleIdx);
 			float unpanned = level*envelope*sinusoid;
 
 			// full left = -1 pan. full right = +1 pan.
@@ -709,11 +1841,14 @@ namespace kernel {
 			// float outputR = unpanned * 0.5*(1 + pan);
 
 			// sum the output to the buffer, using a reduction algorithm to avoid serialization
-			reduceOutputs(voiceState, partialIdx, baseIdx + sampleIdx, outputL, outputR);
+			reduceOutputs(voiceState, partialIdx, numPartials, baseIdx + sampleIdx, outputL, outputR);
 
+			if (voiceState->areEchoesMixed) {
+				continue;
+			}
 			// compute echoes
-			float delayPerEcho = myState->delayState.spaceBetweenEchoesAtIdx(sampleIdx);
-			float ampLossPerEcho = myState->delayState.amplitudeLostPerEchoAtIdx(sampleIdx);
+			float delayPerEcho = delayState->spaceBetweenEchoesAtIdx(sampleIdx);
+			float ampLossPerEcho = delayState->amplitudeLostPerEchoAtIdx(sampleIdx);
 			unsigned delayPerEchoInSamples = delayPerEcho*SAMPLE_RATE;
 			for (unsigned echoVoiceIdx = 1; echoVoiceIdx <= MAX_DELAY_ECHOES; ++echoVoiceIdx) {
 				unsigned curDelayIdx = echoVoiceIdx * delayPerEchoInSamples;
@@ -724,60 +1859,574 @@ namespace kernel {
 				reduceDelayOutputs(voiceState, partialIdx, absDelayIdx, curAmp*outputL, curAmp*outputR);
 			}
 		}
-		updateVoiceParametersIfNeeded(voiceState, voiceNum, partialIdx);
-		// TODO: use a proper reduction algorithm to determine when the note is complete
-		if (partialIdx == NUM_PARTIALS-1 && !myState->volumeEnvelope.isActiveAtEndOfBlock()) {
-			// signal no more samples
-			unsigned bufferEndIdx = NUM_CH * ((baseIdx + (BUFFER_BLOCK_SIZE - 1)) % CIRCULAR_BUFFER_LEN);
-			voiceState->sampleBuffer[bufferEndIdx] = NAN;
+		// the partials that are still going all write the same value, so they needn't synchronize
+		if (volumeEnvelope->isActiveAtEndOfBlock()) {
+			voiceState->arePartialsActive = true;
+		}
+	}
+
+	// everything that precedes rendering the partials of the block at baseIdx
+	__global__ void beginVoiceBlockKernel(SynthState *synthState, unsigned voiceNum, unsigned baseIdx) {
+		SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
+		if (threadIdx.x == 0) {
+			voiceState->arePartialsActive = false;
 		}
+		setAsideEarlierEchoes(voiceState, baseIdx, threadIdx.x);
+	}
+
+	__global__ void mixEchoesKernel(SynthState *synthState, unsigned voiceNum, unsigned baseIdx) {
+		restoreEarlierEchoes(&synthState->voiceStates[voiceNum], baseIdx, threadIdx.x);
+		// echoes can land within the block, so every sample must be restored first
+		__syncthreads();
+		mixEchoesOfSample(synthState, voiceNum, baseIdx, threadIdx.x);
 	}
 
 	__global__ void evaluateSynthVoiceBlockKernel(SynthState *synthState, unsigned voiceNum, unsigned baseIdx, unsigned samplesPerThread, float fundamentalFreq, bool released) {
 	    unsigned partialNum = threadIdx.x;
 		unsigned threadIdWithinPartial = blockIdx.x;
-		computePartialOutput(synthState, voiceNum, baseIdx, partialNum, samplesPerThread, threadIdWithinPartial, fundamentalFreq, released);
+		computePartialOutput(synthState, voiceNum, baseIdx, partialNum, blockDim.x, samplesPerThread, threadIdWithinPartial, fundamentalFreq, released);
+	}
+
+	// Caller must hold the lock of voiceNum.
+	// Voices beyond the current polyphony have no state; they render silence.
+	static bool isVoiceAllocated(float bufferB[BUFFER_BLOCK_SIZE*NUM_CH], unsigned voiceNum) {
+		if (voiceNum >= numVoiceStates) {
+			memset(bufferB, 0, BUFFER_BLOCK_SIZE*NUM_CH*sizeof(float));
+			return false;
+		}
+		return true;
+	}
+
+	// Generates e^(i*h*w) for the harmonics h = 1, 2, 3, ... of w from a single sin/cos, using the Chebyshev recurrence
+	//   cos(h*w) = 2*cos(w)*cos((h-1)*w) - cos((h-2)*w) (and likewise for sin).
+	// Runs in double precision, since the recurrence amplifies rounding errors by up to h/sin(w), which is large for low notes.
+	class HarmonicSeries {
+		double twoCosW, cosPrev, sinPrev, cosCur, sinCur;
+	public:
+		__host__ explicit HarmonicSeries(double w) : twoCosW(2 * cos(w)), cosPrev(1), sinPrev(0), cosCur(cos(w)), sinCur(sin(w)) {}
+		// e^(i*h*w) for the current harmonic h (starting at 1)
+		__host__ double cosine() const {
+			return cosCur;
+		}
+		__host__ double sine() const {
+			return sinCur;
+		}
+		__host__ void next() {
+			double cosNext = twoCosW*cosCur - cosPrev;
+			double sinNext = twoCosW*sinCur - sinPrev;
+			cosPrev = cosCur;
+			sinPrev = sinCur;
+			cosCur = cosNext;
+			sinCur = sinNext;
+		}
+	};
+
+	// zero the outputs of the block before baseIdx so the delay effect can fill them (reduceOutputs does this for partial 0)
+	__host__ static void clearPreviousBlock(SynthVoiceState *voiceState, unsigned baseIdx) {
+		for (unsigned sampleIdx = 0; sampleIdx < BUFFER_BLOCK_SIZE; ++sampleIdx) {
+			unsigned prevIdx = voiceState->bufferIdxOf(baseIdx + sampleIdx - BUFFER_BLOCK_SIZE);
+			voiceState->sampleBuffer[prevIdx + 0] = 0;
+			voiceState->sampleBuffer[prevIdx + 1] = 0;
+		}
+	}
+
+	// Collects partials whose block has started (see partialAtBlockStart) into groups of cpuBackend.numLanes,
+	//   and renders each group as soon as it is full (see SimdKernel.h).
+	class PartialLaneBatch {
+		SynthVoiceState *voiceState;
+		PartialStates *partials;
+		unsigned baseIdx;
+		bool useRotator;
+		// set until the first group is rendered, which also clears the previous block's outputs
+		bool isFirstGroup;
+		unsigned numLanes;
+		simd::PartialLanes lanes;
+		// what the partial at stateIdx needs evaluated at every sample this block (simd::LaneFeature bits)
+		__host__ unsigned featuresOf(unsigned stateIdx) const {
+			unsigned features = 0;
+			if (partials->volumeEnvelopes[stateIdx].hasLfoDepthOverBlock()) {
+				features |= simd::VolumeLfoFeature;
+			}
+			if (!partials->stereoPanEnvelopes[stateIdx].isConstantOverBlock()) {
+				features |= simd::PanMotionFeature;
+			}
+			if (!partials->filterStates[stateIdx].isFlatOverBlock()) {
+				features |= simd::FilterSlopeFeature;
+			}
+			if (!voiceState->areEchoesMixed && !partials->delayStates[stateIdx].areEchoesSilent()) {
+				features |= simd::ScatterEchoesFeature;
+			}
+			return features;
+		}
+	public:
+		// shared, if not NULL, holds the envelopes that every partial shares, already evaluated (see evaluateSharedEnvelopes)
+		__host__ PartialLaneBatch(SynthVoiceState *voiceState, PartialStates *partials, unsigned baseIdx, bool isFirstGroup, const simd::SharedEnvelopeLanes *shared)
+			: voiceState(voiceState), partials(partials), baseIdx(baseIdx), useRotator(isRotatorEnabled), isFirstGroup(isFirstGroup), numLanes(0) {
+			memset(&lanes, 0, sizeof(lanes));
+			lanes.shared = shared;
+			lanes.controlInterval = controlInterval;
+		}
+		// harmonics must be at the partial's harmonic, whose phase step is used if every partial of the group is harmonic
+		__host__ void add(unsigned stateIdx, unsigned partialIdx, bool isHarmonic, const HarmonicSeries &harmonics) {
+			// a single detuned partial sends the whole group down the general (chirping) rotator
+			lanes.isHarmonic = (numLanes == 0 || lanes.isHarmonic) && isHarmonic;
+			// and the group evaluates every feature that any of its partials needs
+			lanes.features = ((numLanes == 0) ? 0 : lanes.features) | featuresOf(stateIdx);
+			lanes.harmonicStepRe[numLanes] = (float)harmonics.cosine();
+			lanes.harmonicStepIm[numLanes] = (float)harmonics.sine();
+			partials->sinusoids[stateIdx].toLanes(&lanes.sinusoid, numLanes);
+			partials->volumeEnvelopes[stateIdx].toLanes(&lanes.volumeEnvelope, numLanes);
+			partials->stereoPanEnvelopes[stateIdx].toLanes(&lanes.stereoPanEnvelope, numLanes);
+			partials->filterStates[stateIdx].toLanes(&lanes.filter, numLanes);
+			partials->delayStates[stateIdx].toLanes(&lanes.delay, numLanes);
+			lanes.level[numLanes] = voiceState->parameterInfo.start->partialLevels[partialIdx];
+			if (++numLanes == cpuBackend.numLanes) {
+				flush();
+			}
+		}
+		// render the partials added since the last full group, if any
+		__host__ void flush() {
+			if (numLanes == 0) {
+				if (isFirstGroup) {
+					// no partial was added at all, but the previous block still needs clearing
+					clearPreviousBlock(voiceState, baseIdx);
+					isFirstGroup = false;
+				}
+				return;
+			}
+			// silence the lanes past the last partial (they still hold finite states from earlier groups)
+			for (unsigned lane = numLanes; lane < cpuBackend.numLanes; ++lane) {
+				lanes.level[lane] = 0.f;
+			}
+			cpuBackend.render(&lanes, numLanes, voiceState->sampleBuffer, voiceState->bufferLen, baseIdx, isFirstGroup, useRotator);
+			isFirstGroup = false;
+			numLanes = 0;
+		}
+	};
+
+	// what computePartialOutput does once the last partial of the block is done
+	__host__ static void finishVoiceBlock(SynthState *synthState, unsigned voiceNum, unsigned numPartials) {
+		SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
+		PartialStates *partials = &synthState->partialStates;
+		// a shared volume envelope is the same for every partial
+		unsigned numChecked = (voiceState->sharedEnvelopes & SharedVolumeEnvelope) ? 1 : numPartials;
+		for (unsigned partialIdx = 0; partialIdx < numChecked; ++partialIdx) {
+			if (partials->volumeEnvelopes[partials->indexOf(voiceNum, 0, partialIdx)].isActiveAtEndOfBlock()) {
+				voiceState->arePartialsActive = true;
+				break;
+			}
+		}
+	}
+
+	// Run the block setup (partialAtBlockStart) for every partial of the voice, storing its result in isHarmonic.
+	// If checkSteadyState is set, also returns whether the voice is in steady state throughout the block (see SteadyStateCache).
+	__host__ static bool startPartialBlocks(SynthState *synthState, unsigned voiceNum, unsigned numPartials, float fundamentalFreq, bool released, bool checkSteadyState, bool *isHarmonic) {
+		SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
+		PartialStates *partials = &synthState->partialStates;
+		bool isSteady = checkSteadyState && voiceState->parameterInfo.start == voiceState->parameterInfo.end;
+		for (unsigned partialIdx = 0; partialIdx < numPartials; ++partialIdx) {
+			unsigned stateIdx = partials->indexOf(voiceNum, 0, partialIdx);
+			isHarmonic[partialIdx] = partialAtBlockStart(synthState, voiceState, stateIdx, partialIdx, fundamentalFreq, released);
+			isSteady = isSteady && isHarmonic[partialIdx]
+				&& partials->volumeEnvelopes[stateIdx].isConstantOverBlock()
+				&& partials->stereoPanEnvelopes[stateIdx].isConstantOverBlock()
+				&& partials->filterStates[stateIdx].isConstantOverBlock()
+				&& (voiceState->areEchoesMixed || partials->delayStates[stateIdx].areEchoesSilent());
+		}
+		return isSteady;
+	}
+
+	// Evaluate the envelopes that the voice's partials render with and all share (see sharedEnvelopesOfVoice) once for the voice,
+	//   from partial 0's states, rather than once per group of partials.
+	// Returns false if they share none of them.
+	__host__ static bool evaluateSharedEnvelopes(SynthState *synthState, unsigned voiceNum, unsigned numPartials, simd::SharedEnvelopeLanes *shared) {
+		unsigned sharedEnvelopes = synthState->voiceStates[voiceNum].sharedEnvelopes;
+		shared->isVolumeShared = (sharedEnvelopes & SharedVolumeEnvelope) != 0;
+		shared->isStereoPanShared = (sharedEnvelopes & SharedStereoPanEnvelope) != 0;
+		shared->isFilterShiftShared = (sharedEnvelopes & SharedFilterShift) != 0;
+		if (numPartials == 0 || !(shared->isVolumeShared || shared->isStereoPanShared || shared->isFilterShiftShared)) {
+			return false;
+		}
+		PartialStates *partials = &synthState->partialStates;
+		unsigned stateIdx = partials->indexOf(voiceNum, 0, 0);
+		for (unsigned lane = 0; lane < cpuBackend.numLanes; ++lane) {
+			partials->volumeEnvelopes[stateIdx].toLanes(&shared->volumeEnvelope, lane);
+			partials->stereoPanEnvelopes[stateIdx].toLanes(&shared->stereoPanEnvelope, lane);
+			partials->filterStates[stateIdx].shiftToLanes(&shared->filterShift, lane);
+		}
+		cpuBackend.evaluateShared(shared);
+		return true;
+	}
+
+	// Vectorized equivalent of calling computePartialOutput for every partial of the voice (see SimdKernel.h),
+	//   once startPartialBlocks has run: each group of cpuBackend.numLanes partials renders together.
+	__host__ static void computePartialOutputsSimd(SynthState *synthState, unsigned voiceNum, unsigned baseIdx, unsigned numPartials, float fundamentalFreq, const bool *isHarmonic) {
+		SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
+		PartialStates *partials = &synthState->partialStates;
+		simd::SharedEnvelopeLanes shared;
+		bool hasShared = evaluateSharedEnvelopes(synthState, voiceNum, numPartials, &shared);
+		PartialLaneBatch batch(voiceState, partials, baseIdx, true, hasShared ? &shared : NULL);
+		// the per-sample phase step of every undetuned partial, in rad/sample
+		HarmonicSeries harmonics((double)fundamentalFreq * INV_SAMPLE_RATE);
+		for (unsigned partialIdx = 0; partialIdx < numPartials; ++partialIdx) {
+			unsigned stateIdx = partials->indexOf(voiceNum, 0, partialIdx);
+			if (isPartialAudible(voiceState, partials, stateIdx, partialIdx)) {
+				batch.add(stateIdx, partialIdx, isHarmonic[partialIdx], harmonics);
+			}
+			harmonics.next();
+		}
+		batch.flush();
+	}
+
+	// Equivalent of computePartialOutputsSimd for voices with many partials, by inverse FFT (see IfftSynth.h).
+	// Every partial's amplitude, frequency, phase and pan are sampled at the three frame centers of the block,
+	//   and the frames are overlap-added into the block.
+	// Unless the voice's echoes are mixed, the echoes of a partial are scattered sample by sample,
+	//   so partials with audible echoes during the block are handed to the SIMD code instead.
+	// So are partials whose volume envelope turns a corner within the block, such as the end of a short attack or release,
+	//   which the frames would otherwise stretch over a whole hop.
+	__host__ static void computePartialOutputsIfft(SynthState *synthState, unsigned voiceNum, unsigned baseIdx, unsigned numPartials, float fundamentalFreq, const bool *isHarmonic) {
+		SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
+		PartialStates *partials = &synthState->partialStates;
+		// the SIMD code clears the previous block with its first group, which here need not hold partial 0
+		clearPreviousBlock(voiceState, baseIdx);
+		// few partials render sample by sample, so they evaluate their envelopes themselves
+		PartialLaneBatch sampledPartials(voiceState, partials, baseIdx, false, NULL);
+		HarmonicSeries harmonics((double)fundamentalFreq * INV_SAMPLE_RATE);
+		ifft::Frame frames[IFFT_FRAMES_PER_BLOCK];
+		for (unsigned frameIdx = 0; frameIdx < IFFT_FRAMES_PER_BLOCK; ++frameIdx) {
+			frames[frameIdx].clear();
+		}
+		for (unsigned partialIdx = 0; partialIdx < numPartials; ++partialIdx) {
+			unsigned stateIdx = partials->indexOf(voiceNum, 0, partialIdx);
+			if (!isPartialAudible(voiceState, partials, stateIdx, partialIdx)) {
+				harmonics.next();
+				continue;
+			}
+			if ((!voiceState->areEchoesMixed && !partials->delayStates[stateIdx].areEchoesSilent())
+				|| partials->volumeEnvelopes[stateIdx].turnsCornerOverBlock()) {
+				sampledPartials.add(stateIdx, partialIdx, isHarmonic[partialIdx], harmonics);
+			} else {
+				const Sinusoidal *sinusoidState = &partials->sinusoids[stateIdx];
+				float level = voiceState->parameterInfo.start->partialLevels[partialIdx];
+				for (unsigned frameIdx = 0; frameIdx < IFFT_FRAMES_PER_BLOCK; ++frameIdx) {
+					// the same envelopes as computePartialOutput, evaluated at the frame center
+					unsigned centerIdx = frameIdx*IFFT_HOP_SIZE;
+					float freq = sinusoidState->freqAtIdx(centerIdx);
+					float envelope = antiAliasedVolumeForFreq(freq)*partials->filterStates[stateIdx].valueAtIdx(centerIdx)*partials->volumeEnvelopes[stateIdx].productAtIdx(centerIdx);
+					float unpanned = level*envelope*sinusoidState->magAtIdx(centerIdx);
+					if (unpanned == 0.f) {
+						continue;
+					}
+					float angle = PIf / 4 * (1 + partials->stereoPanEnvelopes[stateIdx].sumAtIdx(centerIdx));
+					float sinAng, cosAng;
+					FASTSINCOSF(angle, &sinAng, &cosAng);
+					frames[frameIdx].addPartial(freq, sinusoidState->phaseAtIdx(centerIdx), unpanned*cosAng, unpanned*sinAng);
+				}
+			}
+			harmonics.next();
+		}
+		for (unsigned frameIdx = 0; frameIdx < IFFT_FRAMES_PER_BLOCK; ++frameIdx) {
+			frames[frameIdx].transform();
+		}
+		for (unsigned sampleIdx = 0; sampleIdx < BUFFER_BLOCK_SIZE; ++sampleIdx) {
+			float sumL = 0.f, sumR = 0.f;
+			for (unsigned frameIdx = 0; frameIdx < IFFT_FRAMES_PER_BLOCK; ++frameIdx) {
+				int offset = (int)sampleIdx - (int)(frameIdx*IFFT_HOP_SIZE);
+				if (offset > -IFFT_HOP_SIZE && offset < IFFT_HOP_SIZE) {
+					float outputL, outputR;
+					frames[frameIdx].outputAt(offset, &outputL, &outputR);
+					sumL += outputL;
+					sumR += outputR;
+				}
+			}
+			unsigned bufferIdx = voiceState->bufferIdxOf(baseIdx + sampleIdx);
+			voiceState->sampleBuffer[bufferIdx + 0] += sumL;
+			voiceState->sampleBuffer[bufferIdx + 1] += sumR;
+		}
+		sampledPartials.flush();
+	}
+
+	// Play a voice in steady state (see startPartialBlocks) back from its wavetable, building the table first
+	//   if it doesn't hold this note and these parameters yet.
+	__host__ static void computePartialOutputsFromWavetable(SynthState *synthState, unsigned voiceNum, unsigned baseIdx, unsigned numPartials, float fundamentalFreq) {
+		SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
+		PartialStates *partials = &synthState->partialStates;
+		SteadyStateCache *cache = &steadyStateCaches[voiceNum];
+		unsigned parametersVersion = endSnapshotOfVoice[voiceNum]->version;
+		if (!cache->isValid || cache->fundamentalFreq != fundamentalFreq || cache->parametersVersion != parametersVersion) {
+			// every partial is constant over the block, so its values at the block start hold throughout.
+			// Zeroed so that they are initialized even without partials; a table is only built when the note or parameters change.
+			float ampL[MAX_PARTIALS] = { 0.f }, ampR[MAX_PARTIALS] = { 0.f }, phase[MAX_PARTIALS] = { 0.f };
+			for (unsigned partialIdx = 0; partialIdx < numPartials; ++partialIdx) {
+				unsigned stateIdx = partials->indexOf(voiceNum, 0, partialIdx);
+				const Sinusoidal *sinusoidState = &partials->sinusoids[stateIdx];
+				float level = voiceState->parameterInfo.start->partialLevels[partialIdx];
+				float envelope = antiAliasedVolumeForFreq(sinusoidState->freqAtIdx(0))*partials->filterStates[stateIdx].valueAtIdx(0)*partials->volumeEnvelopes[stateIdx].productAtIdx(0);
+				float unpanned = level*envelope*sinusoidState->magAtIdx(0);
+				float angle = PIf / 4 * (1 + partials->stereoPanEnvelopes[stateIdx].sumAtIdx(0));
+				float sinAng, cosAng;
+				FASTSINCOSF(angle, &sinAng, &cosAng);
+				ampL[partialIdx] = unpanned*cosAng;
+				ampR[partialIdx] = unpanned*sinAng;
+				phase[partialIdx] = sinusoidState->phaseAtIdx(0);
+			}
+			cache->table.build(numPartials, ampL, ampR, phase);
+			cache->startPhases.assign(phase, phase + numPartials);
+			cache->isValid = true;
+			cache->fundamentalFreq = fundamentalFreq;
+			cache->parametersVersion = parametersVersion;
+			cache->position = 0;
+		}
+		// periods of the fundamental per sample
+		double step = (double)fundamentalFreq * INV_SAMPLE_RATE / TWICE_PI;
+		for (unsigned sampleIdx = 0; sampleIdx < BUFFER_BLOCK_SIZE; ++sampleIdx) {
+			unsigned absIdx = baseIdx + sampleIdx;
+			// zero the previous frame's outputs so the delay effect can fill them
+			unsigned prevIdx = voiceState->bufferIdxOf(absIdx - BUFFER_BLOCK_SIZE);
+			voiceState->sampleBuffer[prevIdx + 0] = 0;
+			voiceState->sampleBuffer[prevIdx + 1] = 0;
+			double position = cache->position + sampleIdx*step;
+			float outputL, outputR;
+			cache->table.valueAt(position - floor(position), &outputL, &outputR);
+			unsigned bufferIdx = voiceState->bufferIdxOf(absIdx);
+			voiceState->sampleBuffer[bufferIdx + 0] += outputL;
+			voiceState->sampleBuffer[bufferIdx + 1] += outputR;
+		}
+		double nextPosition = cache->position + BUFFER_BLOCK_SIZE*step;
+		cache->position = nextPosition - floor(nextPosition);
+	}
+
+	// As a voice leaves steady state, carry every partial on from the phase the wavetable left it at.
+	// The table plays exact harmonics of the fundamental, which the partials' own (float) phase steps only approximate,
+	//   so over a long note their phases drift apart.
+	__host__ static void resumeFromWavetable(SynthState *synthState, unsigned voiceNum, unsigned numPartials) {
+		PartialStates *partials = &synthState->partialStates;
+		SteadyStateCache *cache = &steadyStateCaches[voiceNum];
+		unsigned numResumed = std::min(numPartials, (unsigned)cache->startPhases.size());
+		for (unsigned partialIdx = 0; partialIdx < numResumed; ++partialIdx) {
+			double phase = cache->startPhases[partialIdx] + (partialIdx + 1)*TWICE_PI*cache->position;
+			partials->sinusoids[partials->indexOf(voiceNum, 0, partialIdx)].setPhase((float)fmod(phase, TWICE_PI));
+		}
+		cache->isValid = false;
+	}
+
+	// The vectorized CPU rendering of one block of a voice: from its wavetable in steady state,
+	//   otherwise by inverse FFT for many partials and with SIMD lanes for the rest.
+	__host__ static void computePartialOutputsVectorized(SynthState *synthState, unsigned voiceNum, unsigned baseIdx, unsigned numPartials, float fundamentalFreq, bool released) {
+		bool isHarmonic[MAX_PARTIALS];
+		bool isSteady = startPartialBlocks(synthState, voiceNum, numPartials, fundamentalFreq, released, isWavetableCacheEnabled, isHarmonic);
+		if (isSteady) {
+			computePartialOutputsFromWavetable(synthState, voiceNum, baseIdx, numPartials, fundamentalFreq);
+		} else {
+			if (steadyStateCaches[voiceNum].isValid) {
+				resumeFromWavetable(synthState, voiceNum, numPartials);
+			}
+			if (isIfftEnabled && numPartials >= IFFT_MIN_PARTIALS) {
+				computePartialOutputsIfft(synthState, voiceNum, baseIdx, numPartials, fundamentalFreq, isHarmonic);
+			} else {
+				computePartialOutputsSimd(synthState, voiceNum, baseIdx, numPartials, fundamentalFreq, isHarmonic);
+			}
+		}
+		finishVoiceBlock(synthState, voiceNum, numPartials);
 	}
 
-	__host__ void evaluateSynthVoiceBlockOnCpu(float bufferB[BUFFER_BLOCK_SIZE*NUM_CH], unsigned voiceNum, unsigned sampleIdx, float fundamentalFreq, bool released) {
-		// need to obtain a lock on the synth state
-		std::unique_lock<std::mutex> stateLock(synthStateMutex);
+	// how far past the end of the block just rendered its echoes can land
+	__host__ static unsigned echoReachOfBlock(SynthState *synthState, unsigned voiceNum, unsigned numPartials) {
+		PartialStates *partials = &synthState->partialStates;
+		// mixed echoes follow partial 0's delay state (see mixEchoesOfSample), as do shared ones
+		const SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
+		unsigned numEchoing = (voiceState->areEchoesMixed || (voiceState->sharedEnvelopes & SharedDelayEnvelope)) ? 1 : numPartials;
+		unsigned reach = 0;
+		for (unsigned partialIdx = 0; partialIdx < numEchoing; ++partialIdx) {
+			reach = std::max(reach, partials->delayStates[partials->indexOf(voiceNum, 0, partialIdx)].maxEchoReach());
+		}
+		return reach;
+	}
+
+	// extend the voice's dirty range (see dirtyRangeBegin) over the block just rendered at baseIdx and the reach of its echoes
+	__host__ static void markDirtyRange(unsigned voiceNum, unsigned baseIdx, unsigned reach) {
+		unsigned end = baseIdx + BUFFER_BLOCK_SIZE + reach;
+		// compare as a difference, since the indices wrap around
+		if (dirtyRangeBegin[voiceNum] == dirtyRangeEnd[voiceNum] || (int)(end - dirtyRangeEnd[voiceNum]) > 0) {
+			dirtyRangeEnd[voiceNum] = end;
+		}
+		dirtyRangeBegin[voiceNum] = baseIdx;
+	}
+
+	// Once every partial has ended, the blocks that follow add nothing to the voice's buffer,
+	//   so whatever lies past the block just rendered at baseIdx is all that is left of the note: its echoes.
+	// Trim the dirty range to the last of them that isn't silent, which makes it an exact measure of the note's tail.
+	// Caller must hold the lock of voiceNum.
+	__host__ static void trimEchoTail(unsigned voiceNum, unsigned baseIdx) {
+		float *sampleBuffer = sampleBufferOfVoice[voiceNum];
+		unsigned bufferLen = sampleBufferLenOfVoice[voiceNum];
+		unsigned blockEnd = baseIdx + BUFFER_BLOCK_SIZE;
+		// a lap past the block's start, the buffer wraps around to the block itself
+		if ((int)(dirtyRangeEnd[voiceNum] - (baseIdx + bufferLen)) > 0) {
+			dirtyRangeEnd[voiceNum] = baseIdx + bufferLen;
+		}
+		float chunk[BUFFER_BLOCK_SIZE*NUM_CH];
+		// compare as a difference, since the indices wrap around
+		while ((int)(dirtyRangeEnd[voiceNum] - blockEnd) > 0) {
+			// scan back from the end of the range, up to a block at a time and never across the end of the buffer
+			unsigned end = dirtyRangeEnd[voiceNum];
+			unsigned endPos = (end - 1) % bufferLen + 1;
+			unsigned length = std::min(std::min(end - blockEnd, (unsigned)BUFFER_BLOCK_SIZE), endPos);
+			memcpySynthStateToHost(chunk, &sampleBuffer[NUM_CH*(endPos - length)], NUM_CH*length*sizeof(float));
+			for (unsigned i = NUM_CH*length; i-- > 0;) {
+				if (chunk[i] != 0.f) {
+					dirtyRangeEnd[voiceNum] = end - length + i / NUM_CH + 1;
+					return;
+				}
+			}
+			dirtyRangeEnd[voiceNum] = end - length;
+		}
+	}
+
+	// zero the voice's dirty range, leaving its whole sample buffer zero.
+	// Caller must hold the lock of voiceNum.
+	__host__ static void clearDirtyRange(unsigned voiceNum) {
+		float *sampleBuffer = sampleBufferOfVoice[voiceNum];
+		unsigned bufferLen = sampleBufferLenOfVoice[voiceNum];
+		unsigned length = std::min(dirtyRangeEnd[voiceNum] - dirtyRangeBegin[voiceNum], bufferLen);
+		unsigned first = dirtyRangeBegin[voiceNum] % bufferLen;
+		// the part up to the end of the buffer, then the part that wrapped around to its start
+		unsigned lengthBeforeWrap = std::min(length, bufferLen - first);
+		memset(&sampleBuffer[NUM_CH*first], 0, NUM_CH*lengthBeforeWrap*sizeof(float));
+		memset(&sampleBuffer[0], 0, NUM_CH*(length - lengthBeforeWrap)*sizeof(float));
+		dirtyRangeEnd[voiceNum] = dirtyRangeBegin[voiceNum];
+	}
+
+	// Once voiceNum's buffer holds nothing but the block just copied out of it (if anything),
+	//   let it use only as much of it as its parameters need, so a voice that played long echoes doesn't keep
+	//   cycling through the whole buffer. The memory stays allocated, so this never allocates or frees.
+	// Not on the GPU, whose dirty range is only a bound.
+	// Caller must hold the lock of voiceNum.
+	__host__ static void shrinkIdleSampleBuffer(unsigned voiceNum) {
+		if (hasCudaDevice() || (int)(dirtyRangeEnd[voiceNum] - (dirtyRangeBegin[voiceNum] + BUFFER_BLOCK_SIZE)) > 0) {
+			return;
+		}
+		// the next block may still start from the parameters the last one did, and the voice may be about to pick up the latest
+		unsigned neededLen = std::max(startSnapshotOfVoice[voiceNum]->sampleBufferLen, endSnapshotOfVoice[voiceNum]->sampleBufferLen);
+		neededLen = std::max(neededLen, latestSampleBufferLen.load());
+		if (neededLen >= sampleBufferLenOfVoice[voiceNum]) {
+			return;
+		}
+		// what's left would land at different places in the shorter buffer, so clear it first
+		clearDirtyRange(voiceNum);
+		setSampleBufferLen(voiceNum, neededLen);
+	}
+
+	// the status of the block of voiceNum just rendered at baseIdx into bufferB (see VoiceBlockStatus),
+	//   once its dirty range and arePartialsActiveOfVoice are up to date.
+	__host__ static VoiceBlockStatus voiceBlockStatus(const float *bufferB, unsigned voiceNum, unsigned baseIdx) {
+		VoiceBlockStatus status;
+		status.arePartialsDone = !arePartialsActiveOfVoice[voiceNum];
+		status.peakLevel = 0.f;
+		for (unsigned i = 0; i < BUFFER_BLOCK_SIZE*NUM_CH; ++i) {
+			status.peakLevel = std::max(status.peakLevel, fabsf(bufferB[i]));
+		}
+		// compare as a difference, since the indices wrap around
+		int tail = (int)(dirtyRangeEnd[voiceNum] - (baseIdx + BUFFER_BLOCK_SIZE));
+		status.tailSamplesRemaining = tail > 0 ? (unsigned)tail : 0;
+		return status;
+	}
+
+	// the status of a block of silence from a voice with no state
+	__host__ static VoiceBlockStatus unallocatedVoiceStatus() {
+		VoiceBlockStatus status;
+		status.arePartialsDone = true;
+		status.peakLevel = 0.f;
+		status.tailSamplesRemaining = 0;
+		return status;
+	}
+
+	__host__ VoiceBlockStatus evaluateSynthVoiceBlockOnCpu(float bufferB[BUFFER_BLOCK_SIZE*NUM_CH], unsigned voiceNum, unsigned sampleIdx, float fundamentalFreq, bool released) {
+		// need to obtain a lock on this voice's state (other voices are free to render concurrently)
+		std::unique_lock<std::mutex> stateLock(voiceStateMutexes[voiceNum]);
+		if (!isVoiceAllocated(bufferB, voiceNum)) {
+			return unallocatedVoiceStatus();
+		}
+		pickUpParameters(voiceNum, true);
 		// move pointer to d_synthState into a local for easy debugging
 		SynthState *synthState = d_synthState;
-		int threadsPerPartial = numThreadsPerPartial();
-		int samplesPerThread = BUFFER_BLOCK_SIZE / threadsPerPartial;
-		for (int partialIdx = 0; partialIdx < NUM_PARTIALS; ++partialIdx) {
-			for (int threadIdWithinPartial = 0; threadIdWithinPartial < threadsPerPartial; ++threadIdWithinPartial) {
-				computePartialOutput(synthState, voiceNum, sampleIdx, partialIdx, samplesPerThread, threadIdWithinPartial, fundamentalFreq, released);
+		unsigned numPartials = numPartialsOfVoice[voiceNum];
+		SynthVoiceState *voiceState = &synthState->voiceStates[voiceNum];
+		voiceState->arePartialsActive = false;
+		// the block's envelopes start from the latest parameters, and those that depend on the partial index now stop being shared
+		sharedEnvelopesOfVoice[voiceNum] &= endSnapshotOfVoice[voiceNum]->compiled.sharedEnvelopes;
+		voiceState->sharedEnvelopes = sharedEnvelopesOfVoice[voiceNum];
+		for (unsigned i = 0; i < BUFFER_BLOCK_SIZE; ++i) {
+			setAsideEarlierEchoes(voiceState, sampleIdx, i);
+		}
+		if (isSimdEnabled) {
+			computePartialOutputsVectorized(synthState, voiceNum, sampleIdx, numPartials, fundamentalFreq, released);
+		} else {
+			int threadsPerPartial = numThreadsPerPartial();
+			int samplesPerThread = BUFFER_BLOCK_SIZE / threadsPerPartial;
+			for (unsigned partialIdx = 0; partialIdx < numPartials; ++partialIdx) {
+				for (int threadIdWithinPartial = 0; threadIdWithinPartial < threadsPerPartial; ++threadIdWithinPartial) {
+					computePartialOutput(synthState, voiceNum, sampleIdx, partialIdx, numPartials, samplesPerThread, threadIdWithinPartial, fundamentalFreq, released);
+				}
 			}
 		}
-		unsigned bufferStartIdx = NUM_CH * (sampleIdx % CIRCULAR_BUFFER_LEN);
-		memcpy(bufferB, &synthState->voiceStates[voiceNum].sampleBuffer[bufferStartIdx], BUFFER_BLOCK_SIZE*NUM_CH*sizeof(float));
+		for (unsigned i = 0; i < BUFFER_BLOCK_SIZE; ++i) {
+			restoreEarlierEchoes(voiceState, sampleIdx, i);
+		}
+		for (unsigned i = 0; i < BUFFER_BLOCK_SIZE; ++i) {
+			mixEchoesOfSample(synthState, voiceNum, sampleIdx, i);
+		}
+		// once every partial has ended, the blocks that follow are silent, and so are their echoes
+		markDirtyRange(voiceNum, sampleIdx, arePartialsActiveOfVoice[voiceNum] ? echoReachOfBlock(synthState, voiceNum, numPartials) : 0);
+		arePartialsActiveOfVoice[voiceNum] = voiceState->arePartialsActive;
+		if (!arePartialsActiveOfVoice[voiceNum]) {
+			trimEchoTail(voiceNum, sampleIdx);
+		}
+		unsigned bufferStartIdx = voiceState->bufferIdxOf(sampleIdx);
+		memcpy(bufferB, &voiceState->sampleBuffer[bufferStartIdx], BUFFER_BLOCK_SIZE*NUM_CH*sizeof(float));
+		VoiceBlockStatus status = voiceBlockStatus(bufferB, voiceNum, sampleIdx);
+		shrinkIdleSampleBuffer(voiceNum);
+		return status;
 	}
 
-	__host__ void evaluateSynthVoiceBlockCuda(float bufferB[BUFFER_BLOCK_SIZE*NUM_CH], unsigned voiceNum, unsigned sampleIdx, float fundamentalFreq, bool released) {
+	__host__ VoiceBlockStatus evaluateSynthVoiceBlockCuda(float bufferB[BUFFER_BLOCK_SIZE*NUM_CH], unsigned voiceNum, unsigned sampleIdx, float fundamentalFreq, bool released) {
+		std::unique_lock<std::mutex> stateLock(voiceStateMutexes[voiceNum]);
+		if (!isVoiceAllocated(bufferB, voiceNum)) {
+			return unallocatedVoiceStatus();
+		}
+		pickUpParameters(voiceNum, true);
 		unsigned threadsPerPartial = numThreadsPerPartial();
 		unsigned samplesPerThread = BUFFER_BLOCK_SIZE / threadsPerPartial;
-		evaluateSynthVoiceBlockKernel << <threadsPerPartial, NUM_PARTIALS >> >(d_synthState, voiceNum, sampleIdx, samplesPerThread, fundamentalFreq, released);
+		beginVoiceBlockKernel << <1, BUFFER_BLOCK_SIZE >> >(d_synthState, voiceNum, sampleIdx);
+		evaluateSynthVoiceBlockKernel << <threadsPerPartial, numPartialsOfVoice[voiceNum] >> >(d_synthState, voiceNum, sampleIdx, samplesPerThread, fundamentalFreq, released);
+		mixEchoesKernel << <1, BUFFER_BLOCK_SIZE >> >(d_synthState, voiceNum, sampleIdx);
 
 		checkCudaError(cudaGetLastError()); //check if error in kernel launch
 		checkCudaError(cudaDeviceSynchronize()); //check for error INSIDE the kernel
 
 		//copy memory into the cpu buffer
 		//Note: this will wait for the kernel to complete first.
-		unsigned bufferStartIdx = NUM_CH * (sampleIdx % CIRCULAR_BUFFER_LEN);
-		checkCudaError(cudaMemcpy(bufferB, &d_synthState->voiceStates[voiceNum].sampleBuffer[bufferStartIdx], BUFFER_BLOCK_SIZE*NUM_CH*sizeof(float), cudaMemcpyDeviceToHost));
+		markDirtyRange(voiceNum, sampleIdx, arePartialsActiveOfVoice[voiceNum] ? sampleBufferLenOfVoice[voiceNum] : 0);
+		checkCudaError(cudaMemcpy(&arePartialsActiveOfVoice[voiceNum], &d_voiceStates[voiceNum].arePartialsActive, sizeof(bool), cudaMemcpyDeviceToHost));
+		if (!arePartialsActiveOfVoice[voiceNum]) {
+			trimEchoTail(voiceNum, sampleIdx);
+		}
+		unsigned bufferStartIdx = NUM_CH * (sampleIdx % sampleBufferLenOfVoice[voiceNum]);
+		checkCudaError(cudaMemcpy(bufferB, &sampleBufferOfVoice[voiceNum][bufferStartIdx], BUFFER_BLOCK_SIZE*NUM_CH*sizeof(float), cudaMemcpyDeviceToHost));
+		return voiceBlockStatus(bufferB, voiceNum, sampleIdx);
 	}
 
-	void evaluateSynthVoiceBlock(float *bufferB, unsigned voiceNum, unsigned baseIdx, float fundamentalFreq, bool released) {
+	VoiceBlockStatus evaluateSynthVoiceBlock(float *bufferB, unsigned voiceNum, unsigned baseIdx, float fundamentalFreq, bool released) {
 		doStartupOnce();
 		if (hasCudaDevice()) {
-			evaluateSynthVoiceBlockCuda(bufferB, voiceNum, baseIdx, fundamentalFreq, released);
+			return evaluateSynthVoiceBlockCuda(bufferB, voiceNum, baseIdx, fundamentalFreq, released);
 		} else {
-			evaluateSynthVoiceBlockOnCpu(bufferB, voiceNum, baseIdx, fundamentalFreq, released);
+			return evaluateSynthVoiceBlockOnCpu(bufferB, voiceNum, baseIdx, fundamentalFreq, released);
 		}
 	}
 
+	// Caller must hold the lock of the voice that owns dest
 	static void memcpyHostToSynthState(void *dest, const void *src, std::size_t numBytes) {
 		// if running on device, copy params to GPU via cudaMemcpy, else normal memcpy on cpu.
 		if (hasCudaDevice()) {
@@ -785,12 +2434,20 @@ namespace kernel {
 			checkCudaError(cudaMemcpy(dest, src, numBytes, cudaMemcpyHostToDevice));
 		} else {
 			// else, copy them using normal memcpy
-			// Must first obtain a lock to the synth data.
-			std::unique_lock<std::mutex> stateLock(synthStateMutex);
 			memcpy(dest, src, numBytes);
 		}
 	}
 
+	// Caller must hold the lock of the voice that owns src
+	static void memcpySynthStateToHost(void *dest, const void *src, std::size_t numBytes) {
+		if (hasCudaDevice()) {
+			checkCudaError(cudaMemcpy(dest, src, numBytes, cudaMemcpyDeviceToHost));
+		} else {
+			memcpy(dest, src, numBytes);
+		}
+	}
+
+	// Caller must hold the lock of the voice that owns dest
 	static void memsetSynthState(void *dest, int value, std::size_t numBytes) {
 		// if running on device, use cudaMemset, else normal memset
 		if (hasCudaDevice()) {
@@ -798,45 +2455,129 @@ namespace kernel {
 			checkCudaError(cudaMemset(dest, value, numBytes));
 		} else {
 			// else, use normal memset
-			// Must first obtain a lock to the synth data.
-			std::unique_lock<std::mutex> stateLock(synthStateMutex);
 			memset(dest, value, numBytes);
 		}
 	}
 
-	static void copyParameterStates(const ParameterStates *newParameters, ParameterStates *dest) {
-		memcpyHostToSynthState(dest, newParameters, sizeof(ParameterStates));
-	}
-
 	void parameterStatesChanged(const ParameterStates *newParameters) {
 		doStartupOnce();
-		static bool hasInitStartParams = false;
-
-		newParameters->incrUUID();
-		for (int i = 0; i < MAX_SIMULTANEOUS_SYNTH_NOTES; ++i) {
-			// If this is the first time we've received parameter states, then that means parameterInfo.start is uninitialized.
-			if (!hasInitStartParams) {
-				copyParameterStates(newParameters, &d_synthState->voiceStates[i].parameterInfo.start);
+		std::unique_lock<std::mutex> poolLock(voicePoolMutex);
+		unsigned numPartials = newParameters->numPartials;
+		if (numPartials > d_partialStates.capacity) {
+			// make room for the extra partials before any voice can pick them up. Rare (and slow), but every partial keeps its state.
+			lockAllVoices();
+			resizePartialStates(numVoiceStates, numPartials);
+			unlockAllVoices();
+		}
+		ParameterSnapshot *snapshot = newParameterSnapshot(newParameters);
+		// likewise, make room for the echoes the new parameters can produce, one voice at a time
+		//   (and keep any voice that shrinks its buffer meanwhile from undoing it).
+		latestSampleBufferLen = snapshot->sampleBufferLen;
+		for (unsigned i = 0; i < numVoiceStates; ++i) {
+			growSampleBuffer(i, snapshot->sampleBufferLen);
+		}
+		// each voice moves on to the new snapshot at the start of its next block (see pickUpParameters)
+		releaseSnapshot(currentSnapshot.exchange(snapshot));
+		if (!hasReceivedParameters) {
+			// the defaults the voices were set up with were never meant to be heard,
+			//   so rather than gliding from them, every voice starts right away with the first parameters it is given.
+			for (unsigned i = 0; i < numVoiceStates; ++i) {
+				std::unique_lock<std::mutex> stateLock(voiceStateMutexes[i]);
+				pickUpParameters(i, false);
 			}
-			copyParameterStates(newParameters, &d_synthState->voiceStates[i].parameterInfo.end);
+			hasReceivedParameters = true;
 		}
-		hasInitStartParams = true;
+		reclaimRetiredSnapshots();
 	}
 
 	void onNoteStart(unsigned voiceNum) {
 		doStartupOnce();
-		// need to go through and properly initialize all the note's state information:
-		//   partial phases, ADSR states, etc.
-		int threadsPerPartial = numThreadsPerPartial();
-		PartialState *partialStates = new PartialState[threadsPerPartial*NUM_PARTIALS];
-		for (int t = 0; t < threadsPerPartial; ++t) {
-			for (int i = 0; i < NUM_PARTIALS; ++i) {
-				partialStates[t*i] = PartialState(d_synthState, voiceNum, i);
-			}
-		}
-		memcpyHostToSynthState(&d_synthState->voiceStates[voiceNum].partialStates, partialStates, sizeof(PartialState)*threadsPerPartial*NUM_PARTIALS);
-		memsetSynthState(&d_synthState->voiceStates[voiceNum].sampleBuffer, 0, CIRCULAR_BUFFER_LEN*NUM_CH*sizeof(float));
-		delete partialStates;
+		std::unique_lock<std::mutex> stateLock(voiceStateMutexes[voiceNum]);
+		if (voiceNum < numVoiceStates) {
+			// need to go through and properly initialize all the note's state information:
+			//   partial phases, ADSR states, etc.
+			resetPartialStates(voiceNum, 0, numPartialsOfVoice[voiceNum]);
+			sharedEnvelopesOfVoice[voiceNum] = AllSharedEnvelopes;
+			if (hasCudaDevice()) {
+				// the GPU's echoes are only bounded, but clearing the whole buffer there is a device-side memset
+				memsetSynthState(sampleBufferOfVoice[voiceNum], 0, sampleBufferLenOfVoice[voiceNum]*NUM_CH*sizeof(float));
+				dirtyRangeEnd[voiceNum] = dirtyRangeBegin[voiceNum];
+			} else {
+				clearDirtyRange(voiceNum);
+				shrinkIdleSampleBuffer(voiceNum);
+			}
+			arePartialsActiveOfVoice[voiceNum] = true;
+			steadyStateCaches[voiceNum].isValid = false;
+		}
+	}
+
+	void setPolyphony(unsigned numVoices) {
+		numVoices = std::max(1u, std::min(numVoices, (unsigned)MAX_SIMULTANEOUS_SYNTH_NOTES));
+		std::unique_lock<std::mutex> poolLock(voicePoolMutex);
+		requestedNumVoiceStates = numVoices;
+		if (d_synthState == NULL) {
+			// not started yet: startup() will allocate the requested number of voices.
+			return;
+		}
+		if (numVoices != numVoiceStates) {
+			lockAllVoices();
+			allocateVoiceStates(numVoices);
+			unlockAllVoices();
+		}
+	}
+
+	unsigned getPolyphony() {
+		std::unique_lock<std::mutex> poolLock(voicePoolMutex);
+		return requestedNumVoiceStates;
+	}
+
+	void setSimdEnabled(bool enabled) {
+		isSimdEnabled = enabled;
+	}
+
+	void setRotatorEnabled(bool enabled) {
+		isRotatorEnabled = enabled;
+	}
+
+	void setControlInterval(unsigned numSamples) {
+		unsigned interval = 1;
+		while (interval * 2 <= numSamples && interval < MAX_CONTROL_INTERVAL) {
+			interval *= 2;
+		}
+		controlInterval = interval;
+	}
+
+	void setIfftEnabled(bool enabled) {
+		isIfftEnabled = enabled;
+	}
+
+	void setWavetableCacheEnabled(bool enabled) {
+		isWavetableCacheEnabled = enabled;
+	}
+
+	const char* getBackendName() {
+		doStartupOnce();
+		if (hasCudaDevice()) {
+			return "cuda";
+		}
+		return isSimdEnabled ? cpuBackend.name : "scalar";
+	}
+
+	bool setBackend(const char *name) {
+		doStartupOnce();
+		simd::Backend backends[SIMD_MAX_BACKENDS];
+		unsigned numBackends = simd::detectSupportedBackends(backends);
+		for (unsigned i = 0; i < numBackends; ++i) {
+			if (strcmp(backends[i].name, name) == 0) {
+				// wait for every voice to finish its block, as setPolyphony does
+				std::unique_lock<std::mutex> poolLock(voicePoolMutex);
+				lockAllVoices();
+				cpuBackend = backends[i];
+				unlockAllVoices();
+				return true;
+			}
+		}
+		return false;
 	}
 
 }
\ No newline at end of file
@@ -43,12 +43,43 @@ namespace kernel {
 			return pieces[pieceNum].level;
 		}
 		HOST DEVICE unsigned numPoints() const {
-			for (int p = 0; p < PIECEWISE_MAX_PIECES; ++p) {
-				if (isnan(pieces[p].level)) {
-					return p;
+			// the existing points form a prefix of the array, so binary search for the first non-existent one
+			unsigned lo = 0, hi = PIECEWISE_MAX_PIECES;
+			while (lo < hi) {
+				unsigned mid = (lo + hi) / 2;
+				if (isnan(pieces[mid].level)) {
+					hi = mid;
+				} else {
+					lo = mid + 1;
 				}
 			}
-			return PIECEWISE_MAX_PIECES;
+			return lo;
+		}
+		// number of points (out of the first numPoints) whose start time is <= time.
+		// Point times are increasing, so this is a binary search.
+		HOST DEVICE unsigned numPointsUpTo(float time, unsigned numPoints) const {
+			unsigned lo = 0, hi = numPoints;
+			while (lo < hi) {
+				unsigned mid = (lo + hi) / 2;
+				if (pieces[mid].time <= time) {
+					lo = mid + 1;
+				} else {
+					hi = mid;
+				}
+			}
+			return lo;
+		}
+		// the function's value at the given time: linear between points, and flat before the first and after the last
+		HOST DEVICE float valueAt(float time, unsigned numPoints) const {
+			unsigned numBefore = numPointsUpTo(time, numPoints);
+			if (numBefore == 0) {
+				return pieces[0].level;
+			}
+			if (numBefore == numPoints) {
+				return pieces[numPoints - 1].level;
+			}
+			const Point &p0 = pieces[numBefore - 1], &p1 = pieces[numBefore];
+			return p0.level + (time - p0.time) / (p1.time - p0.time) * (p1.level - p0.level);
 		}
 		// shift the point and all following points such that:
 		//   this point starts at the absolute time newStartTime
@@ -62,7 +93,7 @@ namespace kernel {
 			}
 			pieces[pointNum].level = newLevel;
 			float shiftAmt = newStartTime - pieces[pointNum].time;
-			for (int p = pointNum; p < numPoints(); ++p) {
+			for (int p = pointNum; p < (int)numPoints(); ++p) {
 				pieces[p].time += shiftAmt;
 			}
 			return newStartTime;
@@ -184,16 +215,17 @@ namespace kernel {
 			value = std::max(value, INV_SAMPLE_RATE*MIN_ADSR_SEGMENT_LENGTH_SAMPLES);
 			levelsAndLengths[(unsigned)mode][1] = value;
 		}
-		inline HOST DEVICE float getSegmentStartLevel(Mode mode, unsigned partialIdx=0) const {
-			return levelsAndLengths[(unsigned)mode][0] * getAmplificationFor(partialIdx);
+		// partialPos is the partial's position within the spectrum: partialIdx / numPartials, from 0 (fundamental) to just below 1.
+		inline HOST DEVICE float getSegmentStartLevel(Mode mode, float partialPos=0) const {
+			return levelsAndLengths[(unsigned)mode][0] * getAmplificationFor(partialPos);
 		}
-		inline HOST DEVICE float getSegmentLength(Mode mode, unsigned partialIdx=0) const {
-			return levelsAndLengths[(unsigned)mode][1] * getTimeScaleFor(partialIdx);
+		inline HOST DEVICE float getSegmentLength(Mode mode, float partialPos=0) const {
+			return levelsAndLengths[(unsigned)mode][1] * getTimeScaleFor(partialPos);
 		}
-		inline HOST DEVICE float getSegmentSlope(Mode mode, unsigned partialIdx = 0) const {
+		inline HOST DEVICE float getSegmentSlope(Mode mode, float partialPos = 0) const {
 			float y0 =  getSegmentStartLevel(mode);
 			float y1 = getSegmentStartLevel((Mode)((unsigned)mode + 1));
-			float length = getSegmentLength(mode, partialIdx);
+			float length = getSegmentLength(mode, partialPos);
 			return (y1 - y0) / length;
 		}
 		inline void setStartLevel(float level) {
@@ -252,11 +284,15 @@ namespace kernel {
 		inline HOST DEVICE float getAmplificationByPartialIdx() const {
 			return amplifyByPartialIdx;
 		}
-		inline HOST DEVICE float getTimeScaleFor(unsigned partialIdx) const {
-			return 1.f + scaleByPartialIdx*partialIdx/NUM_PARTIALS;
+		// whether partials see different segment lengths or levels
+		inline HOST DEVICE bool dependsOnPartialIdx() const {
+			return scaleByPartialIdx != 0 || amplifyByPartialIdx != 0;
+		}
+		inline HOST DEVICE float getTimeScaleFor(float partialPos) const {
+			return 1.f + scaleByPartialIdx*partialPos;
 		}
-		inline HOST DEVICE float  getAmplificationFor(unsigned partialIdx) const {
-			return 1.f + amplifyByPartialIdx*partialIdx / NUM_PARTIALS;
+		inline HOST DEVICE float  getAmplificationFor(float partialPos) const {
+			return 1.f + amplifyByPartialIdx*partialPos;
 		}
 	};
 
@@ -277,6 +313,9 @@ namespace kernel {
 		inline HOST DEVICE ADSR* getDepthAdsr() {
 			return &lfoDepth;
 		}
+		inline HOST DEVICE bool dependsOnPartialIdx() const {
+			return lfoFreq.dependsOnPartialIdx() || lfoDepth.dependsOnPartialIdx();
+		}
 	};
 
 	class ADSRLFOEnvelope {
@@ -286,9 +325,18 @@ namespace kernel {
 		inline HOST DEVICE ADSR* getAdsr() {
 			return &adsr;
 		}
+		inline HOST DEVICE const ADSR* getAdsr() const {
+			return &adsr;
+		}
 		inline HOST DEVICE LFO* getLfo() {
 			return &lfo;
 		}
+		inline HOST DEVICE const LFO* getLfo() const {
+			return &lfo;
+		}
+		inline HOST DEVICE bool dependsOnPartialIdx() const {
+			return adsr.dependsOnPartialIdx() || lfo.dependsOnPartialIdx();
+		}
 	};
 
 	class DetuneEnvelope {
@@ -325,9 +373,19 @@ namespace kernel {
 		inline HOST DEVICE ADSRLFOEnvelope* getSpaceBetweenEchoes() {
 			return &spaceBetweenEchoes;
 		}
+		inline HOST DEVICE const ADSRLFOEnvelope* getSpaceBetweenEchoes() const {
+			return &spaceBetweenEchoes;
+		}
 		inline HOST DEVICE ADSRLFOEnvelope* getAmplitudeLostPerEcho() {
 			return &amplitudeLostPerEcho;
 		}
+		inline HOST DEVICE const ADSRLFOEnvelope* getAmplitudeLostPerEcho() const {
+			return &amplitudeLostPerEcho;
+		}
+		// if not, every partial's echoes follow the same envelopes, and they can be applied to the sum of the partials instead.
+		inline HOST DEVICE bool dependsOnPartialIdx() const {
+			return spaceBetweenEchoes.dependsOnPartialIdx() || amplitudeLostPerEcho.dependsOnPartialIdx();
+		}
 	};
 
 	class FilterEnvelope {
@@ -351,25 +409,25 @@ namespace kernel {
 	};
 
 	// Struct to hold ALL parameter states at a single instant in time.
-	// There will be two of these sent during each synthesis block:
+	// Each synthesis block sees two of these:
 	//   1 for at the start of the block,
 	//   another for at the end of the block.
 	//   The actual value at any time will be the linear interpolation of the two.
 	struct ParameterStates {
-		static unsigned nextUUID;
-		mutable unsigned UUID;
-		// hand-drawn partial envelopes
-		float partialLevels[NUM_PARTIALS];
+		// number of partials to synthesize, between 1 and MAX_PARTIALS
+		unsigned numPartials;
+		// hand-drawn partial envelopes. Levels past numPartials are always 0.
+		float partialLevels[MAX_PARTIALS];
 		ADSRLFOEnvelope volumeEnvelope;
 		ADSRLFOEnvelope stereoPanEnvelope;
 		DetuneEnvelope detuneEnvelope;
 		DelayEnvelope delayEnvelope;
 		FilterEnvelope filterEnvelope;
 		ParameterStates() {
-			UUID = nextUUID++;
 			// initialize partials to uniform level
-			for (int p = 0; p < NUM_PARTIALS; ++p) {
-				partialLevels[p] = 0.5f / NUM_PARTIALS;
+			numPartials = DEFAULT_NUM_PARTIALS;
+			for (unsigned p = 0; p < MAX_PARTIALS; ++p) {
+				partialLevels[p] = p < numPartials ? 0.5f / numPartials : 0.f;
 			}
 			// default to no volume LFO
 			volumeEnvelope.getLfo()->getDepthAdsr()->setSustain(0.f);
@@ -385,19 +443,86 @@ namespace kernel {
 			delayEnvelope.getAmplitudeLostPerEcho()->getLfo()->getDepthAdsr()->setSustain(0.f);
 			delayEnvelope.getSpaceBetweenEchoes()->getLfo()->getDepthAdsr()->setSustain(0.f);
 		}
-		void incrUUID() const {
-			UUID = nextUUID++;
+		// change the number of partials.
+		// Levels are stored relative to the partial count, so the existing partials are rescaled to keep their drawn shape,
+		//   and any new partials start at the default (half) level.
+		void setNumPartials(unsigned n) {
+			n = std::max(1u, std::min(n, (unsigned)MAX_PARTIALS));
+			for (unsigned p = 0; p < MAX_PARTIALS; ++p) {
+				if (p >= n) {
+					partialLevels[p] = 0.f;
+				} else if (p >= numPartials) {
+					partialLevels[p] = 0.5f / n;
+				} else {
+					partialLevels[p] *= (float)numPartials / n;
+				}
+			}
+			numPartials = n;
+		}
+	};
+
+	// What evaluateSynthVoiceBlock reports about the voice after rendering a block.
+	struct VoiceBlockStatus {
+		// whether every partial's volume envelope has run its course by the end of the block
+		bool arePartialsDone;
+		// the largest magnitude of any sample of the block, in either channel
+		float peakLevel;
+		// how many samples past the end of the block echoes may still land, at most
+		unsigned tailSamplesRemaining;
+		// whether the block is the last one of the note: everything after it would be silent, so the voice can be freed
+		bool isNoteFinished() const {
+			return arePartialsDone && tailSamplesRemaining == 0;
 		}
 	};
 
 	// Call to evaluate the next N samples of a synthesizer voice into bufferB.
-	void evaluateSynthVoiceBlock(float *bufferB, unsigned voiceNum, unsigned baseIdx, float fundamentalFreq, bool released);
+	VoiceBlockStatus evaluateSynthVoiceBlock(float *bufferB, unsigned voiceNum, unsigned baseIdx, float fundamentalFreq, bool released);
 
-	// Call whenever the user edits one of the synth parameters
+	// Same as evaluateSynthVoiceBlock, but always uses the CPU implementation.
+	// Only valid when no Cuda device is in use (i.e. the synth state lives in host memory).
+	// Exposed for benchmarking.
+	VoiceBlockStatus evaluateSynthVoiceBlockOnCpu(float *bufferB, unsigned voiceNum, unsigned baseIdx, float fundamentalFreq, bool released);
+
+	// Call whenever the user edits one of the synth parameters.
+	// The parameters are copied once, however many voices there are; each voice moves on to them at the start of its next block.
 	void parameterStatesChanged(const ParameterStates *newParameters);
 
 	// Call at the onset of a note BEFORE calculating the next block
 	void onNoteStart(unsigned voiceNum);
+
+	// Call while no notes are playing (e.g. from prepareToPlay) to allocate the state for numVoices voices,
+	//   between 1 and MAX_SIMULTANEOUS_SYNTH_NOTES. Defaults to DEFAULT_SIMULTANEOUS_SYNTH_NOTES.
+	// Valid voice numbers are then 0 to numVoices-1; any note in progress is lost.
+	void setPolyphony(unsigned numVoices);
+	unsigned getPolyphony();
+
+	// The CPU implementation evaluates several partials per instruction, using the widest SIMD instruction set
+	//   the processor supports (see SimdKernel.h), unless NEVER_USE_SIMD is set.
+	// Pass false to fall back to the scalar code, which renders one partial at a time (e.g. to compare the two).
+	void setSimdEnabled(bool enabled);
+	// The SIMD code advances each partial's sinusoid with a complex rotator by default (a few multiply-adds per sample);
+	//   pass false to evaluate sin at every sample instead. Has no effect on the scalar or CUDA code.
+	void setRotatorEnabled(bool enabled);
+	// The SIMD code evaluates each partial's envelopes, LFOs, filter and pan every numSamples samples
+	//   (DEFAULT_CONTROL_INTERVAL to start with) and interpolates the resulting gain of each channel linearly in between.
+	// Pass 1 to evaluate them at every sample (the quality mode). Rounded down to a power of two, up to MAX_CONTROL_INTERVAL.
+	// Has no effect on the scalar or CUDA code.
+	void setControlInterval(unsigned numSamples);
+	// Pass true to have the SIMD code synthesize voices with IFFT_MIN_PARTIALS or more partials by inverse FFT
+	//   and overlap-add instead (see IfftSynth.h), which approximates each partial as a stationary sinusoid
+	//   over IFFT_HOP_SIZE samples. Partials whose echoes are audible during a block, or whose volume envelope turns a corner,
+	//   are still rendered sample by sample.
+	// Off by default: it is only somewhat faster, and smears LFOs, which move a partial within a hop.
+	void setIfftEnabled(bool enabled);
+	// With the SIMD code enabled, a voice whose output has become exactly periodic (every partial an undetuned harmonic
+	//   with constant amplitude and pan, no audible echoes and no parameter changes) is played back from a wavetable
+	//   of one period until that changes. Pass false to always synthesize every block.
+	void setWavetableCacheEnabled(bool enabled);
+	// the implementation in use: "cuda", or on the CPU "avx512", "avx2", "sse" or "scalar".
+	const char* getBackendName();
+	// Makes the SIMD code use the named instruction set ("avx512", "avx2" or "sse") rather than the widest one,
+	//   e.g. to compare them. Returns false, changing nothing, if the processor doesn't support it.
+	bool setBackend(const char *name);
 }
 
 using namespace kernel;
@@ -0,0 +1,308 @@
+/*
+==============================================================================
+
+OfflineRenderer.cpp
+Headless command-line renderer: MIDI file in, WAV file out.
+
+Drives kernel::evaluateSynthVoiceBlock directly, as fast as the kernel allows.
+No editor, no AudioDeviceManager and no per-voice fill threads are involved,
+so this runs on machines without audio hardware (e.g. build boxes).
+
+==============================================================================
+*/
+
+// Only the non-GUI JUCE modules are needed, so include them individually
+// (AppConfig.h first, so that they pick up the project configuration).
+#include "AppConfig.h"
+#include "modules/juce_core/juce_core.h"
+#include "modules/juce_audio_basics/juce_audio_basics.h"
+#include "modules/juce_audio_formats/juce_audio_formats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../CudaSynth/kernel.h"
+#include "../CudaSynth/defines.h"
+
+using namespace juce;
+
+// how long to keep rendering after the last midi event while waiting for released notes to end.
+#define MAX_TAIL_SECONDS 30
+#define OUTPUT_BITS_PER_SAMPLE 24
+
+// Mirrors AdditiveSynthVoice (PluginProcessor.cpp), minus the fill thread:
+//   blocks are rendered synchronously, on demand, by the thread that mixes them.
+class OfflineVoice
+{
+	unsigned myVoiceNumber;
+	float block[BUFFER_BLOCK_SIZE*NUM_CH];
+	// index into the kernel's circular buffer of the next block to render
+	unsigned baseIdx;
+	// read position within `block`
+	unsigned sampleIdx;
+	// whether `block` is the last one of the note
+	bool isLastBlock;
+	float fundamentalFreq;
+	bool isActive;
+	bool wasNoteReleased;
+	int midiNote;
+	// sample at which the current note started; used to pick a voice to steal
+	int64 startTime;
+public:
+	// set while the sustain pedal holds a released note
+	bool isSustained;
+
+	OfflineVoice(unsigned voiceNum) : myVoiceNumber(voiceNum), baseIdx(0), sampleIdx(BUFFER_BLOCK_SIZE), isLastBlock(false),
+		fundamentalFreq(0), isActive(false), wasNoteReleased(false), midiNote(-1), startTime(0), isSustained(false) {
+		memset(block, 0, sizeof(block));
+	}
+	bool isPlaying() const {
+		return isActive;
+	}
+	bool isPlayingHeldNote(int note) const {
+		return isActive && !wasNoteReleased && midiNote == note;
+	}
+	int64 getStartTime() const {
+		return startTime;
+	}
+	void startNote(int note, int64 when) {
+		midiNote = note;
+		startTime = when;
+		isActive = true;
+		wasNoteReleased = false;
+		isSustained = false;
+		// trigger a render of the first block on the next call to renderInto()
+		sampleIdx = BUFFER_BLOCK_SIZE;
+		isLastBlock = false;
+		fundamentalFreq = (float)(MidiMessage::getMidiNoteInHertz(note) * TWICE_PI);
+		kernel::onNoteStart(myVoiceNumber);
+	}
+	void stopNote() {
+		wasNoteReleased = true;
+		isSustained = false;
+	}
+	void renderInto(AudioSampleBuffer &outputBuffer, int startSample, int numSamples) {
+		if (!isActive) {
+			return;
+		}
+		for (int localIdx = startSample; localIdx < startSample + numSamples; ++localIdx) {
+			if (sampleIdx == BUFFER_BLOCK_SIZE) {
+				if (isLastBlock) {
+					// the partials and their echoes have all died away
+					isActive = false;
+					return;
+				}
+				sampleIdx = 0;
+				isLastBlock = kernel::evaluateSynthVoiceBlock(block, myVoiceNumber, baseIdx, fundamentalFreq, wasNoteReleased).isNoteFinished();
+				baseIdx += BUFFER_BLOCK_SIZE;
+			}
+			for (int ch = outputBuffer.getNumChannels(); --ch >= 0;) {
+				outputBuffer.addSample(ch, localIdx, block[sampleIdx * NUM_CH + ch]);
+			}
+			++sampleIdx;
+		}
+	}
+};
+
+class OfflineRenderer
+{
+	OwnedArray<OfflineVoice> voices;
+	bool sustainPedalDown;
+
+	OfflineVoice* findVoiceForNewNote() {
+		OfflineVoice *oldest = nullptr;
+		for (int i = 0; i < voices.size(); ++i) {
+			if (!voices[i]->isPlaying()) {
+				return voices[i];
+			}
+			if (oldest == nullptr || voices[i]->getStartTime() < oldest->getStartTime()) {
+				oldest = voices[i];
+			}
+		}
+		// all voices busy: steal the one that has been playing the longest
+		return oldest;
+	}
+	void handleMidiEvent(const MidiMessage &m, int64 when) {
+		if (m.isNoteOn()) {
+			findVoiceForNewNote()->startNote(m.getNoteNumber(), when);
+		} else if (m.isNoteOff()) {
+			for (int i = 0; i < voices.size(); ++i) {
+				if (voices[i]->isPlayingHeldNote(m.getNoteNumber())) {
+					if (sustainPedalDown) {
+						voices[i]->isSustained = true;
+					} else {
+						voices[i]->stopNote();
+					}
+				}
+			}
+		} else if (m.isSustainPedalOn()) {
+			sustainPedalDown = true;
+		} else if (m.isSustainPedalOff()) {
+			sustainPedalDown = false;
+			for (int i = 0; i < voices.size(); ++i) {
+				if (voices[i]->isSustained) {
+					voices[i]->stopNote();
+				}
+			}
+		} else if (m.isAllNotesOff() || m.isAllSoundOff()) {
+			for (int i = 0; i < voices.size(); ++i) {
+				voices[i]->stopNote();
+			}
+		}
+	}
+	bool anyVoicePlaying() const {
+		for (int i = 0; i < voices.size(); ++i) {
+			if (voices[i]->isPlaying()) {
+				return true;
+			}
+		}
+		return false;
+	}
+public:
+	OfflineRenderer(unsigned numVoices) : sustainPedalDown(false) {
+		for (unsigned i = 0; i < numVoices; ++i) {
+			voices.add(new OfflineVoice(i));
+		}
+	}
+	// render the whole sequence into writer. Returns the number of frames written.
+	int64 render(const MidiMessageSequence &events, AudioFormatWriter &writer) {
+		AudioSampleBuffer chunk(NUM_CH, BUFFER_BLOCK_SIZE);
+		const int numEvents = events.getNumEvents();
+		const int64 hardEnd = (int64)((events.getEndTime() + MAX_TAIL_SECONDS) * SAMPLE_RATE);
+		int64 pos = 0;
+		int eventIdx = 0;
+		while (pos < hardEnd) {
+			// apply every event that is due at the current position
+			int64 nextEventPos = hardEnd;
+			while (eventIdx < numEvents) {
+				const MidiMessage &m = events.getEventPointer(eventIdx)->message;
+				int64 eventPos = (int64)(m.getTimeStamp() * SAMPLE_RATE);
+				if (eventPos > pos) {
+					nextEventPos = eventPos;
+					break;
+				}
+				handleMidiEvent(m, pos);
+				++eventIdx;
+			}
+			if (eventIdx == numEvents && !anyVoicePlaying()) {
+				break;
+			}
+			// render up to the next event (or one block, whichever is smaller)
+			int numSamples = (int)jmin((int64)BUFFER_BLOCK_SIZE, nextEventPos - pos);
+			chunk.clear();
+			for (int i = 0; i < voices.size(); ++i) {
+				voices[i]->renderInto(chunk, 0, numSamples);
+			}
+			writer.writeFromAudioSampleBuffer(chunk, 0, numSamples);
+			pos += numSamples;
+		}
+		return pos;
+	}
+};
+
+static bool loadParameterStates(const File &file, ParameterStates &params) {
+	// the file is the raw in-memory image of a ParameterStates,
+	//   i.e. exactly what the kernel copies to the device.
+	MemoryBlock data;
+	if (!file.loadFileAsData(data)) {
+		fprintf(stderr, "Could not read parameter file %s\n", file.getFullPathName().toRawUTF8());
+		return false;
+	}
+	if (data.getSize() != sizeof(ParameterStates)) {
+		fprintf(stderr, "Parameter file %s is %i bytes; expected %i (was it written by a build with different defines.h?)\n",
+			file.getFullPathName().toRawUTF8(), (int)data.getSize(), (int)sizeof(ParameterStates));
+		return false;
+	}
+	memcpy(&params, data.getData(), sizeof(ParameterStates));
+	return true;
+}
+
+static bool saveParameterStates(const File &file, const ParameterStates &params) {
+	return file.replaceWithData(&params, sizeof(ParameterStates));
+}
+
+static void printUsage(const char *argv0) {
+	fprintf(stderr, "usage: %s [-p parameters.bin] [-n polyphony] input.mid output.wav\n", argv0);
+	fprintf(stderr, "       %s --dump-default-parameters parameters.bin\n", argv0);
+}
+
+int main(int argc, char **argv) {
+	File cwd = File::getCurrentWorkingDirectory();
+	if (argc == 3 && strcmp(argv[1], "--dump-default-parameters") == 0) {
+		ParameterStates defaults;
+		return saveParameterStates(cwd.getChildFile(String::fromUTF8(argv[2])), defaults) ? 0 : 1;
+	}
+
+	ParameterStates params;
+	int numVoices = DEFAULT_SIMULTANEOUS_SYNTH_NOTES;
+	int argIdx = 1;
+	while (argc > argIdx + 1 && argv[argIdx][0] == '-') {
+		if (strcmp(argv[argIdx], "-p") == 0) {
+			if (!loadParameterStates(cwd.getChildFile(String::fromUTF8(argv[argIdx + 1])), params)) {
+				return 1;
+			}
+		} else if (strcmp(argv[argIdx], "-n") == 0) {
+			numVoices = atoi(argv[argIdx + 1]);
+			if (numVoices < 1 || numVoices > MAX_SIMULTANEOUS_SYNTH_NOTES) {
+				fprintf(stderr, "Polyphony must be between 1 and %i\n", MAX_SIMULTANEOUS_SYNTH_NOTES);
+				return 1;
+			}
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+		argIdx += 2;
+	}
+	if (argc != argIdx + 2) {
+		printUsage(argv[0]);
+		return 1;
+	}
+	File midiPath = cwd.getChildFile(String::fromUTF8(argv[argIdx]));
+	File wavPath = cwd.getChildFile(String::fromUTF8(argv[argIdx + 1]));
+
+	// read the midi file and merge all of its tracks into one time-ordered sequence
+	FileInputStream midiStream(midiPath);
+	MidiFile midiFile;
+	if (midiStream.failedToOpen() || !midiFile.readFrom(midiStream)) {
+		fprintf(stderr, "Could not read midi file %s\n", midiPath.getFullPathName().toRawUTF8());
+		return 1;
+	}
+	midiFile.convertTimestampTicksToSeconds();
+	MidiMessageSequence events;
+	for (int t = 0; t < midiFile.getNumTracks(); ++t) {
+		events.addSequence(*midiFile.getTrack(t), 0.0, 0.0, midiFile.getLastTimestamp() + 1.0);
+	}
+	events.updateMatchedPairs();
+
+	// open the output
+	wavPath.deleteFile();
+	ScopedPointer<FileOutputStream> wavStream(wavPath.createOutputStream());
+	if (wavStream == nullptr) {
+		fprintf(stderr, "Could not open %s for writing\n", wavPath.getFullPathName().toRawUTF8());
+		return 1;
+	}
+	WavAudioFormat wavFormat;
+	ScopedPointer<AudioFormatWriter> writer(wavFormat.createWriterFor(wavStream, SAMPLE_RATE, NUM_CH, OUTPUT_BITS_PER_SAMPLE, StringPairArray(), 0));
+	if (writer == nullptr) {
+		fprintf(stderr, "Could not create a wav writer\n");
+		return 1;
+	}
+	// the writer now owns the stream
+	wavStream.release();
+
+	kernel::setPolyphony(numVoices);
+	kernel::parameterStatesChanged(&params);
+
+	OfflineRenderer renderer(numVoices);
+	double startMs = Time::getMillisecondCounterHiRes();
+	int64 numFrames = renderer.render(events, *writer);
+	double elapsedSec = (Time::getMillisecondCounterHiRes() - startMs) * 0.001;
+	writer = nullptr; // flush & close the file
+
+	double audioSec = (double)numFrames / SAMPLE_RATE;
+	printf("Rendered %.2f s of audio (%i events) in %.3f s: %.2fx realtime\n",
+		audioSec, events.getNumEvents(), elapsedSec, elapsedSec > 0 ? audioSec / elapsedSec : 0.0);
+	return 0;
+}